@@ -0,0 +1,391 @@
+// spacetime-bench: sweeps body counts over every force backend and
+// integrator, plus the gravity-well update, and writes the timings as JSON.
+// With --baseline it compares against an earlier run and exits non-zero on
+// regressions.
+
+#include "EglContext.h"
+#include "GravityWell.h"
+#include "Integrators.h"
+#include "PhysicsEngine.h"
+#include "Scenarios.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+constexpr double NaN = std::numeric_limits<double>::quiet_NaN();
+constexpr int MAX_ENERGY_BODIES = 20000;
+constexpr size_t WELL_BUDGET = 4096; // matches Renderer
+constexpr int BODY_COUNTS[] = {3, 100, 1000, 10000, 100000, 1000000};
+
+const char *USAGE =
+    "usage: spacetime-bench [options]\n"
+    "  --out FILE         JSON results (bench.json)\n"
+    "  --baseline FILE    compare against an earlier results file\n"
+    "  --tolerance X      allowed slowdown before a regression (0.10)\n"
+    "  --max-bodies N     largest body count in the sweep (1000000)\n"
+    "  --budget S         wall-clock seconds per case (2)\n"
+    "  --sim-time T       simulated time per case for energy drift (1)\n"
+    "  --no-gpu           skip GPU backends and the gravity well\n";
+
+struct Options {
+    std::string out = "bench.json";
+    std::string baseline;
+    double tolerance = 0.10;
+    int maxBodies = 1000000;
+    double budget = 2.0;
+    double simTime = 1.0;
+    double dt = 0.01;
+    bool gpu = true;
+};
+
+// One flat JSON object: string fields and numeric fields (NaN is null).
+struct Record {
+    std::map<std::string, std::string> text;
+    std::map<std::string, double> num;
+
+    std::string key() const {
+        std::string k;
+        for (const auto &[name, value] : text)
+            k += value + "/";
+        for (const char *name : {"bodies", "vertex_budget"})
+            if (auto it = num.find(name); it != num.end())
+                k += std::to_string(static_cast<long long>(it->second)) + "/";
+        return k;
+    }
+};
+
+struct Backend {
+    const char *key;
+    ForceBackend backend;
+    bool resident;
+    bool gpu;
+    double scaling; // cost exponent in N, used to skip hopeless cases
+};
+constexpr Backend BACKENDS[] = {
+    {"cpu", ForceBackend::CpuDirect, false, false, 2.0},
+    {"bh", ForceBackend::BarnesHut, false, false, 1.2},
+    {"pm", ForceBackend::ParticleMesh, false, false, 1.0},
+    {"gpu", ForceBackend::GpuDirect, false, true, 2.0},
+    {"gpu-resident", ForceBackend::GpuDirect, true, true, 2.0},
+};
+
+Options parseArgs(int argc, char **argv) {
+    Options o;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc)
+                throw std::invalid_argument(arg + " needs a value\n" + USAGE);
+            return argv[++i];
+        };
+        if (arg == "--out")
+            o.out = value();
+        else if (arg == "--baseline")
+            o.baseline = value();
+        else if (arg == "--tolerance")
+            o.tolerance = std::stod(value());
+        else if (arg == "--max-bodies")
+            o.maxBodies = std::stoi(value());
+        else if (arg == "--budget")
+            o.budget = std::stod(value());
+        else if (arg == "--sim-time")
+            o.simTime = std::stod(value());
+        else if (arg == "--no-gpu")
+            o.gpu = false;
+        else if (arg == "--help" || arg == "-h") {
+            std::fputs(USAGE, stdout);
+            std::exit(0);
+        } else
+            throw std::invalid_argument("unknown option '" + arg + "'\n" +
+                                        USAGE);
+    }
+    return o;
+}
+
+std::vector<Scenarios::BodyInit> makeBodies(int n) {
+    if (n == 3)
+        return Scenarios::figureEight();
+    // Keep the density of the default 100-body cube as n grows.
+    double space = 50.0 * std::max(1.0, std::cbrt(n / 100.0));
+    return Scenarios::randomCube(n, 100.0, space, 1);
+}
+
+Record benchPhysics(const Options &o, const Backend &b, Integrator integrator,
+                    int n) {
+    PhysicsEngine engine(b.backend);
+    engine.setGpuResident(b.resident);
+    engine.setIntegrator(integrator);
+    for (const auto &body : makeBodies(n))
+        engine.addBody(body.mass, body.position, body.velocity);
+    if (b.gpu)
+        engine.prepareGpu();
+
+    bool energy = n <= MAX_ENERGY_BODIES;
+    double e0 = energy ? engine.totalEnergy() : 0.0;
+
+    // Run to the target simulated time or until the budget is spent,
+    // whichever comes first, but always at least one step.
+    auto target = static_cast<uint64_t>(std::llround(o.simTime / o.dt));
+    uint64_t steps = 0;
+    auto begin = Clock::now();
+    double elapsed = 0.0;
+    do {
+        engine.step(o.dt);
+        ++steps;
+        if (b.gpu && b.resident)
+            glFinish();
+        elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+    } while (steps < target && elapsed < o.budget);
+    engine.syncToHost();
+
+    double drift = NaN;
+    if (energy) {
+        double e1 = engine.totalEnergy();
+        drift = e0 != 0.0 ? (e1 - e0) / std::abs(e0) : e1 - e0;
+    }
+
+    double fullEvals = double(engine.forceEvaluations()) / double(n);
+    Record r;
+    r.text = {{"kind", "physics"},
+              {"backend", b.key},
+              {"integrator", Integrators::info(integrator).key}};
+    r.num = {{"bodies", double(n)},
+             {"steps", double(steps)},
+             {"sim_time", double(steps) * o.dt},
+             {"ms_per_step", 1e3 * elapsed / double(steps)},
+             {"ms_per_force_eval", 1e3 * elapsed / fullEvals},
+             {"energy_drift", drift}};
+    return r;
+}
+
+// `grid` samples the particle-mesh potential instead of summing bodies.
+Record benchWell(const Options &o, int n, bool grid) {
+    ParticleStore store;
+    for (const auto &body : makeBodies(n))
+        store.add(body.mass, body.position, body.velocity);
+
+    GravityWell well(200.0f, WELL_BUDGET);
+    well.setPotentialGrid(grid);
+    uint64_t updates = 0;
+    auto begin = Clock::now();
+    double elapsed = 0.0;
+    do {
+        well.updateFromBodies(store, 0.5f);
+        ++updates;
+        elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+    } while (elapsed < 0.25 * o.budget && updates < 1000);
+    glFinish();
+    elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+
+    Record r;
+    r.text = {{"kind", "gravity_well"}};
+    if (grid)
+        r.text["source"] = "grid";
+    r.num = {{"bodies", double(n)},
+             {"vertex_budget", double(WELL_BUDGET)},
+             {"ms_per_update", 1e3 * elapsed / double(updates)}};
+    return r;
+}
+
+void writeJson(const std::string &path, const std::vector<Record> &records,
+               const char *renderer) {
+    std::ofstream out(path);
+    if (!out)
+        throw std::runtime_error("cannot write " + path);
+
+    out << "{\n  \"renderer\": \"" << renderer << "\",\n"
+        << "  \"cpu_kernel\": \"" << DirectSum::isaName() << "\",\n"
+        << "  \"results\": [\n";
+    // One object per line so baselines diff cleanly.
+    for (size_t i = 0; i < records.size(); ++i) {
+        out << "    {";
+        bool first = true;
+        for (const auto &[name, value] : records[i].text) {
+            out << (first ? "" : ", ") << '"' << name << "\": \"" << value
+                << '"';
+            first = false;
+        }
+        for (const auto &[name, value] : records[i].num) {
+            out << ", \"" << name << "\": ";
+            if (std::isnan(value))
+                out << "null";
+            else
+                out << value;
+        }
+        out << (i + 1 < records.size() ? "},\n" : "}\n");
+    }
+    out << "  ]\n}\n";
+}
+
+// Reads the flat result objects written by writeJson; not a general parser.
+std::vector<Record> readJson(const std::string &path) {
+    std::ifstream in(path);
+    if (!in)
+        throw std::runtime_error("cannot read baseline " + path);
+
+    static const std::regex field(
+        R"re("(\w+)":\s*(?:"([^"]*)"|(null)|([-+0-9.eE]+)))re");
+    std::vector<Record> records;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.find("\"kind\"") == std::string::npos)
+            continue;
+        Record r;
+        for (std::sregex_iterator it(line.begin(), line.end(), field), end;
+             it != end; ++it) {
+            const std::smatch &m = *it;
+            if (m[2].matched)
+                r.text[m[1]] = m[2];
+            else if (m[3].matched)
+                r.num[m[1]] = NaN;
+            else
+                r.num[m[1]] = std::stod(m[4]);
+        }
+        records.push_back(std::move(r));
+    }
+    return records;
+}
+
+// Prints slowdowns beyond the tolerance and drift that grew by more than
+// 10x; returns the number of regressions.
+int compare(const std::vector<Record> &baseline,
+            const std::vector<Record> &current, double tolerance) {
+    std::map<std::string, const Record *> byKey;
+    for (const auto &r : baseline)
+        byKey[r.key()] = &r;
+
+    int regressions = 0, compared = 0;
+    std::printf("\n%-44s %12s %12s %9s\n", "case", "baseline", "current",
+                "change");
+    for (const auto &r : current) {
+        auto it = byKey.find(r.key());
+        if (it == byKey.end())
+            continue;
+        const Record &base = *it->second;
+
+        for (const char *metric : {"ms_per_step", "ms_per_update"}) {
+            auto now = r.num.find(metric), was = base.num.find(metric);
+            if (now == r.num.end() || was == base.num.end() ||
+                !(was->second > 0.0))
+                continue;
+            ++compared;
+            double change = now->second / was->second - 1.0;
+            bool worse = change > tolerance;
+            regressions += worse;
+            if (worse || change < -tolerance)
+                std::printf("%-44s %10.4g ms %10.4g ms %+8.1f%%%s\n",
+                            r.key().c_str(), was->second, now->second,
+                            100.0 * change, worse ? "  REGRESSION" : "");
+        }
+
+        // Drift is only comparable over the same simulated time.
+        auto now = r.num.find("energy_drift");
+        auto was = base.num.find("energy_drift");
+        if (now != r.num.end() && was != base.num.end() &&
+            !std::isnan(now->second) && !std::isnan(was->second) &&
+            r.num.at("sim_time") == base.num.at("sim_time") &&
+            std::abs(now->second) > 10.0 * std::abs(was->second) &&
+            std::abs(now->second) > 1e-12) {
+            ++regressions;
+            std::printf("%-44s drift %.3e -> %.3e  REGRESSION\n",
+                        r.key().c_str(), was->second, now->second);
+        }
+    }
+    std::printf("%d metrics compared, %d regressions (tolerance %.0f%%)\n",
+                compared, regressions, 100.0 * tolerance);
+    return regressions;
+}
+
+int run(const Options &o) {
+    std::unique_ptr<EglContext> gl;
+    if (o.gpu && EglContext::available()) {
+        try {
+            gl = std::make_unique<EglContext>();
+        } catch (const std::exception &e) {
+            std::fprintf(stderr, "GPU cases skipped: %s\n", e.what());
+        }
+    }
+    const char *renderer =
+        gl ? reinterpret_cast<const char *>(glGetString(GL_RENDERER))
+           : "none";
+
+    std::vector<Record> records;
+    for (const Backend &b : BACKENDS) {
+        if (b.gpu && !gl)
+            continue;
+        double lastMs = 0.0;
+        int lastN = 0;
+        for (int n : BODY_COUNTS) {
+            if (n > o.maxBodies)
+                break;
+            // Extrapolate from the previous size and skip cases whose
+            // first step alone would blow far past the budget.
+            if (lastN > 0 &&
+                lastMs * std::pow(double(n) / lastN, b.scaling) >
+                    1e3 * 10.0 * o.budget) {
+                std::fprintf(stderr, "%-12s n=%-8d skipped (over budget)\n",
+                             b.key, n);
+                continue;
+            }
+            for (size_t k = 0; k < Integrators::TABLE.size(); ++k) {
+                Record r = benchPhysics(o, b, static_cast<Integrator>(k), n);
+                std::fprintf(stderr,
+                             "%-12s %-9s n=%-8d %10.4g ms/step %10.4g "
+                             "ms/eval drift %.2e\n",
+                             b.key, r.text["integrator"].c_str(), n,
+                             r.num["ms_per_step"], r.num["ms_per_force_eval"],
+                             r.num["energy_drift"]);
+                lastMs = std::max(lastMs, r.num["ms_per_step"]);
+                records.push_back(std::move(r));
+            }
+            lastN = n;
+        }
+    }
+
+    // The well update is a CPU loop but owns a GL buffer.
+    if (gl)
+        for (int n : BODY_COUNTS) {
+            if (n > std::min(o.maxBodies, 100000))
+                break;
+            for (bool grid : {false, true}) {
+                Record r = benchWell(o, n, grid);
+                std::fprintf(stderr, "gravity_well%-5s n=%-8d %10.4g "
+                             "ms/update\n",
+                             grid ? "/grid" : "", n, r.num["ms_per_update"]);
+                records.push_back(std::move(r));
+            }
+        }
+
+    writeJson(o.out, records, renderer);
+    std::printf("wrote %zu results to %s\n", records.size(), o.out.c_str());
+
+    if (!o.baseline.empty())
+        return compare(readJson(o.baseline), records, o.tolerance) > 0 ? 1
+                                                                        : 0;
+    return 0;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    try {
+        return run(parseArgs(argc, argv));
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "[Fatal Error] %s\n", e.what());
+        return 2;
+    }
+}
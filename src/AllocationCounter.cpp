@@ -0,0 +1,91 @@
+#include "AllocationCounter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef SPACETIME_COUNT_ALLOCATIONS
+namespace {
+std::atomic<uint64_t> allocations{0};
+
+void *allocate(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *allocateAligned(size_t size, std::align_val_t align) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    size_t a = static_cast<size_t>(align);
+    size = (std::max<size_t>(size, 1) + a - 1) / a * a;
+#ifdef _WIN32
+    void *p = _aligned_malloc(size, a);
+#else
+    void *p = std::aligned_alloc(a, size);
+#endif
+    if (p)
+        return p;
+    throw std::bad_alloc();
+}
+
+void releaseAligned(void *p) noexcept {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+} // namespace
+
+// Replaceable global allocation functions; the rest of the standard set
+// forwards to these.
+void *operator new(size_t size) { return allocate(size); }
+void *operator new[](size_t size) { return allocate(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    try {
+        return allocate(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return operator new(size, std::nothrow);
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+
+void *operator new(size_t size, std::align_val_t align) {
+    return allocateAligned(size, align);
+}
+void *operator new[](size_t size, std::align_val_t align) {
+    return allocateAligned(size, align);
+}
+void operator delete(void *p, std::align_val_t) noexcept {
+    releaseAligned(p);
+}
+void operator delete[](void *p, std::align_val_t) noexcept {
+    releaseAligned(p);
+}
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+    releaseAligned(p);
+}
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+    releaseAligned(p);
+}
+
+namespace AllocationCounter {
+bool enabled() noexcept { return true; }
+uint64_t total() noexcept {
+    return allocations.load(std::memory_order_relaxed);
+}
+} // namespace AllocationCounter
+#else
+namespace AllocationCounter {
+bool enabled() noexcept { return false; }
+uint64_t total() noexcept { return 0; }
+} // namespace AllocationCounter
+#endif
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+// Counts every global operator new across all threads, so steady-state
+// loops can be checked for heap churn. Built in unless CMake's
+// SPACETIME_COUNT_ALLOCATIONS is off, in which case enabled() is false and
+// the count stays 0. Allocations made by malloc directly (ImGui, drivers)
+// are not seen.
+namespace AllocationCounter {
+bool enabled() noexcept;
+uint64_t total() noexcept;
+} // namespace AllocationCounter
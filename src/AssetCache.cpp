@@ -0,0 +1,129 @@
+#include "AssetCache.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include <algorithm>
+#include <iostream>
+#include <stb_image.h>
+#include <unordered_map>
+
+namespace AssetCache {
+namespace {
+
+template <class T> struct Registry {
+    std::unordered_map<std::string, std::weak_ptr<const T>> entries;
+
+    template <class Load>
+    std::shared_ptr<const T> get(const std::string &key, Load &&load) {
+        auto &slot = entries[key];
+        if (auto live = slot.lock())
+            return live;
+        auto fresh = std::make_shared<const T>(load());
+        slot = fresh;
+        return fresh;
+    }
+
+    size_t live() noexcept {
+        std::erase_if(entries,
+                      [](const auto &e) { return e.second.expired(); });
+        return entries.size();
+    }
+};
+
+Registry<Mesh> &meshes() {
+    static Registry<Mesh> r;
+    return r;
+}
+
+// A texture together with the image it was made from, which texture()
+// hands out aliased so the image lives as long as the texture.
+struct LoadedTexture {
+    std::shared_ptr<const Image> image;
+    Texture2D texture;
+};
+
+Registry<LoadedTexture> &textures() {
+    static Registry<LoadedTexture> r;
+    return r;
+}
+
+Registry<Image> &images() {
+    static Registry<Image> r;
+    return r;
+}
+
+Image decode(const std::string &path) {
+    Image image;
+    int n;
+    stbi_set_flip_vertically_on_load(true);
+    auto *img = stbi_load(path.c_str(), &image.width, &image.height, &n, 4);
+    if (!img) {
+        std::cerr << "Failed to load texture: " << path << "\n";
+        return {};
+    }
+    image.rgba.assign(img, img + size_t(image.width) * image.height * 4);
+    stbi_image_free(img);
+    return image;
+}
+
+LoadedTexture loadTexture(const std::string &path) {
+    LoadedTexture loaded{image(path), {}};
+    const Image &img = *loaded.image;
+    if (img.rgba.empty())
+        return loaded;
+    glBindTexture(GL_TEXTURE_2D, loaded.texture.id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, img.width, img.height, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, img.rgba.data());
+    glGenerateMipmap(GL_TEXTURE_2D);
+    return loaded;
+}
+
+} // namespace
+
+std::shared_ptr<const Mesh> sphere() {
+    return meshes().get("uvSphere", [] { return Mesh::uvSphere(); });
+}
+
+std::shared_ptr<const Texture2D> texture(const std::string &path) {
+    auto loaded = textures().get(path, [&] { return loadTexture(path); });
+    return {loaded, &loaded->texture};
+}
+
+std::shared_ptr<const Image> image(const std::string &path) {
+    return images().get(path, [&] { return decode(path); });
+}
+
+void resample(const Image &image, int size, unsigned char *dst) {
+    if (image.rgba.empty()) {
+        std::fill_n(dst, size_t(size) * size * 4, 128);
+        return;
+    }
+    int w = image.width, h = image.height;
+    const unsigned char *src = image.rgba.data();
+    for (int y = 0; y < size; ++y) {
+        float fy = std::max(0.0f, (y + 0.5f) * h / size - 0.5f);
+        int y0 = std::min(int(fy), h - 1), y1 = std::min(y0 + 1, h - 1);
+        float ty = fy - y0;
+        for (int x = 0; x < size; ++x) {
+            float fx = std::max(0.0f, (x + 0.5f) * w / size - 0.5f);
+            int x0 = std::min(int(fx), w - 1), x1 = std::min(x0 + 1, w - 1);
+            float tx = fx - x0;
+            for (int c = 0; c < 4; ++c) {
+                float a = src[(y0 * w + x0) * 4 + c];
+                float b = src[(y0 * w + x1) * 4 + c];
+                float d = src[(y1 * w + x0) * 4 + c];
+                float e = src[(y1 * w + x1) * 4 + c];
+                float top = a + (b - a) * tx, bottom = d + (e - d) * tx;
+                dst[(y * size + x) * 4 + c] = static_cast<unsigned char>(
+                    top + (bottom - top) * ty + 0.5f);
+            }
+        }
+    }
+}
+
+size_t liveMeshes() noexcept { return meshes().live(); }
+size_t liveTextures() noexcept { return textures().live(); }
+
+} // namespace AssetCache
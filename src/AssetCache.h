@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Mesh.h"
+#include "raii.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+// Reference-counted GL assets shared between bodies. Each distinct mesh or
+// texture is uploaded once; the cache only holds weak references, so an
+// asset is freed when its last handle goes away. Render thread only.
+namespace AssetCache {
+
+// An image file decoded to RGBA8, bottom row first as GL expects. Empty if
+// the file could not be loaded.
+struct Image {
+    int width = 0, height = 0;
+    std::vector<unsigned char> rgba;
+};
+
+std::shared_ptr<const Mesh> sphere();
+
+// A texture that failed to load is cached as an empty texture so the path
+// is not decoded again. The texture keeps its image, so image() of the same
+// path reuses the decode.
+std::shared_ptr<const Texture2D> texture(const std::string &path);
+
+std::shared_ptr<const Image> image(const std::string &path);
+// Bilinear resample of `image` into a size x size RGBA8 layer; an empty
+// image gives a grey one.
+void resample(const Image &image, int size, unsigned char *dst);
+
+size_t liveMeshes() noexcept;
+size_t liveTextures() noexcept;
+
+} // namespace AssetCache
@@ -0,0 +1,237 @@
+#include "BarnesHut.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+inline int octantOf(const glm::dvec3 &p, const glm::dvec3 &c) noexcept {
+    return (p.x >= c.x ? 1 : 0) | (p.y >= c.y ? 2 : 0) | (p.z >= c.z ? 4 : 0);
+}
+
+inline void addQuadrupole(std::array<double, 6> &q, double m,
+                          const glm::dvec3 &d) noexcept {
+    double r2 = glm::dot(d, d);
+    q[0] += m * (3.0 * d.x * d.x - r2);
+    q[1] += m * (3.0 * d.x * d.y);
+    q[2] += m * (3.0 * d.x * d.z);
+    q[3] += m * (3.0 * d.y * d.y - r2);
+    q[4] += m * (3.0 * d.y * d.z);
+    q[5] += m * (3.0 * d.z * d.z - r2);
+}
+} // namespace
+
+BarnesHut::BarnesHut(double theta, bool quadrupole)
+    : theta_{theta}, quadrupole_{quadrupole} {}
+
+void BarnesHut::build(const ParticleStore &store) {
+    auto n = static_cast<uint32_t>(store.size());
+    order_.resize(n);
+    scratch_.resize(n);
+    std::iota(order_.begin(), order_.end(), 0u);
+
+    glm::dvec3 lo = store.position(0), hi = lo;
+    for (uint32_t i = 0; i < n; ++i) {
+        glm::dvec3 p = store.position(i);
+        lo = glm::dvec3(std::min(lo.x, p.x), std::min(lo.y, p.y),
+                        std::min(lo.z, p.z));
+        hi = glm::dvec3(std::max(hi.x, p.x), std::max(hi.y, p.y),
+                        std::max(hi.z, p.z));
+    }
+    glm::dvec3 extent = hi - lo;
+    double half =
+        0.5 * std::max({extent.x, extent.y, extent.z}) * 1.0001 + 1e-9;
+
+    nodes_.clear();
+    nodes_.push_back(Node{(lo + hi) * 0.5, half, {}, 0.0, {}, 0, 0, 0, n});
+    split(0, store, 0);
+    computeMoments(0, store);
+}
+
+void BarnesHut::split(uint32_t nodeIdx, const ParticleStore &store,
+                      int depth) {
+    Node node = nodes_[nodeIdx];
+    if (node.end - node.begin <= LEAF_SIZE || depth >= MAX_DEPTH)
+        return;
+
+    std::array<uint32_t, 8> counts{};
+    for (uint32_t k = node.begin; k < node.end; ++k)
+        ++counts[octantOf(store.position(order_[k]), node.center)];
+
+    std::array<uint32_t, 9> offsets{};
+    offsets[0] = node.begin;
+    for (int o = 0; o < 8; ++o)
+        offsets[o + 1] = offsets[o] + counts[o];
+
+    std::array<uint32_t, 8> cursor;
+    std::copy_n(offsets.begin(), 8, cursor.begin());
+    for (uint32_t k = node.begin; k < node.end; ++k) {
+        uint32_t i = order_[k];
+        scratch_[cursor[octantOf(store.position(i), node.center)]++] = i;
+    }
+    std::copy(scratch_.begin() + node.begin, scratch_.begin() + node.end,
+              order_.begin() + node.begin);
+
+    auto first = static_cast<uint32_t>(nodes_.size());
+    uint32_t children = 0;
+    double quarter = node.halfSize * 0.5;
+    for (int o = 0; o < 8; ++o) {
+        if (counts[o] == 0)
+            continue;
+        glm::dvec3 c = node.center + glm::dvec3((o & 1) ? quarter : -quarter,
+                                                (o & 2) ? quarter : -quarter,
+                                                (o & 4) ? quarter : -quarter);
+        nodes_.push_back(
+            Node{c, quarter, {}, 0.0, {}, 0, 0, offsets[o], offsets[o + 1]});
+        ++children;
+    }
+    nodes_[nodeIdx].firstChild = first;
+    nodes_[nodeIdx].childCount = children;
+
+    for (uint32_t c = 0; c < children; ++c)
+        split(first + c, store, depth + 1);
+}
+
+void BarnesHut::computeMoments(uint32_t nodeIdx,
+                               const ParticleStore &store) {
+    Node &node = nodes_[nodeIdx];
+    double m = 0.0;
+    glm::dvec3 weighted{0.0};
+    std::array<double, 6> q{};
+
+    if (node.childCount == 0) {
+        for (uint32_t k = node.begin; k < node.end; ++k) {
+            uint32_t i = order_[k];
+            m += store.m[i];
+            weighted += store.position(i) * store.m[i];
+        }
+        glm::dvec3 com = m > 0.0 ? weighted / m : node.center;
+        if (quadrupole_)
+            for (uint32_t k = node.begin; k < node.end; ++k) {
+                uint32_t i = order_[k];
+                addQuadrupole(q, store.m[i], store.position(i) - com);
+            }
+        node.mass = m;
+        node.com = com;
+        node.quad = q;
+        return;
+    }
+
+    uint32_t first = node.firstChild, count = node.childCount;
+    for (uint32_t c = first; c < first + count; ++c) {
+        computeMoments(c, store);
+        m += nodes_[c].mass;
+        weighted += nodes_[c].com * nodes_[c].mass;
+    }
+
+    Node &self = nodes_[nodeIdx];
+    glm::dvec3 com = m > 0.0 ? weighted / m : self.center;
+    if (quadrupole_)
+        for (uint32_t c = first; c < first + count; ++c) {
+            const Node &child = nodes_[c];
+            for (int k = 0; k < 6; ++k)
+                q[k] += child.quad[k];
+            addQuadrupole(q, child.mass, child.com - com);
+        }
+    self.mass = m;
+    self.com = com;
+    self.quad = q;
+}
+
+glm::dvec3 BarnesHut::accelerationAt(uint32_t self,
+                                     const ParticleStore &store, double G,
+                                     double softening) const {
+    const glm::dvec3 p = store.position(self);
+    const double theta2 = theta_ * theta_;
+    glm::dvec3 acc{0.0};
+
+    std::array<uint32_t, 8 * MAX_DEPTH + 8> stack;
+    size_t top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const Node &node = nodes_[stack[--top]];
+        if (node.mass <= 0.0)
+            continue;
+
+        if (node.childCount == 0) {
+            for (uint32_t k = node.begin; k < node.end; ++k) {
+                uint32_t j = order_[k];
+                if (j == self)
+                    continue;
+                glm::dvec3 d = store.position(j) - p;
+                double invDist = 1.0 / std::sqrt(glm::dot(d, d) + softening);
+                acc += d * (G * store.m[j] * invDist * invDist * invDist);
+            }
+            continue;
+        }
+
+        glm::dvec3 d = node.com - p;
+        double r2 = glm::dot(d, d);
+        double size = 2.0 * node.halfSize;
+        glm::dvec3 rel = glm::abs(p - node.center);
+        bool inside = rel.x <= node.halfSize && rel.y <= node.halfSize &&
+                      rel.z <= node.halfSize;
+
+        if (inside || size * size >= theta2 * r2) {
+            for (uint32_t c = 0; c < node.childCount; ++c)
+                stack[top++] = node.firstChild + c;
+            continue;
+        }
+
+        double r2s = r2 + softening;
+        double invDist = 1.0 / std::sqrt(r2s);
+        double invDist3 = invDist * invDist * invDist;
+        acc += d * (G * node.mass * invDist3);
+
+        if (quadrupole_) {
+            // Field point relative to the node's centre of mass.
+            glm::dvec3 r = -d;
+            const auto &q = node.quad;
+            glm::dvec3 qr(q[0] * r.x + q[1] * r.y + q[2] * r.z,
+                          q[1] * r.x + q[3] * r.y + q[4] * r.z,
+                          q[2] * r.x + q[4] * r.y + q[5] * r.z);
+            double rqr = glm::dot(r, qr);
+            double invDist5 = invDist3 * invDist * invDist;
+            acc += (qr - r * (2.5 * rqr / r2s)) * (G * invDist5);
+        }
+    }
+    return acc;
+}
+
+void BarnesHut::computeAccelerations(ParticleStore &store, double G,
+                                     double softening) {
+    if (store.empty())
+        return;
+
+    build(store);
+
+    // Walk bodies in tree order so neighbouring tasks share cached nodes.
+    ThreadPool::shared().parallelFor(
+        order_.size(), 256, [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; ++k) {
+                uint32_t i = order_[k];
+                store.setAcceleration(
+                    i, accelerationAt(i, store, G, softening));
+            }
+        });
+}
+
+void BarnesHut::computeAccelerations(ParticleStore &store,
+                                     std::span<const uint32_t> targets,
+                                     double G, double softening) {
+    if (store.empty() || targets.empty())
+        return;
+
+    build(store);
+
+    ThreadPool::shared().parallelFor(
+        targets.size(), 64, [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; ++k) {
+                uint32_t i = targets[k];
+                store.setAcceleration(
+                    i, accelerationAt(i, store, G, softening));
+            }
+        });
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "ParticleStore.h"
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <span>
+#include <vector>
+
+// Barnes–Hut octree gravity. The tree is rebuilt on every call, nodes are
+// accepted when size / distance < theta and contribute their monopole and
+// (optionally) traceless quadrupole moment about the centre of mass.
+class BarnesHut {
+  public:
+    explicit BarnesHut(double theta = 0.5, bool quadrupole = true);
+
+    void setTheta(double theta) noexcept { theta_ = theta; }
+    double getTheta() const noexcept { return theta_; }
+    void setQuadrupole(bool on) noexcept { quadrupole_ = on; }
+    bool getQuadrupole() const noexcept { return quadrupole_; }
+
+    void computeAccelerations(ParticleStore &store, double G,
+                              double softening);
+    // Builds the tree over every body but only walks it for `targets`.
+    void computeAccelerations(ParticleStore &store,
+                              std::span<const uint32_t> targets, double G,
+                              double softening);
+
+    size_t nodeCount() const noexcept { return nodes_.size(); }
+
+  private:
+    static constexpr uint32_t LEAF_SIZE = 8;
+    static constexpr int MAX_DEPTH = 48;
+
+    struct Node {
+        glm::dvec3 center;
+        double halfSize;
+        glm::dvec3 com;
+        double mass;
+        // xx, xy, xz, yy, yz, zz
+        std::array<double, 6> quad;
+        uint32_t firstChild; // 0 for leaves
+        uint32_t childCount;
+        uint32_t begin, end; // range into order_
+    };
+
+    double theta_;
+    bool quadrupole_;
+
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> order_;
+    std::vector<uint32_t> scratch_;
+
+    void build(const ParticleStore &store);
+    void split(uint32_t nodeIdx, const ParticleStore &store, int depth);
+    void computeMoments(uint32_t nodeIdx, const ParticleStore &store);
+
+    glm::dvec3 accelerationAt(uint32_t self, const ParticleStore &store,
+                              double G, double softening) const;
+};
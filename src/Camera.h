@@ -22,6 +22,7 @@ class Camera {
     void moveRight(float amount);
     void moveUp(float amount);
     void updateMouse(double xpos, double ypos);
+    void resetMouse() { firstMouse = true; }
 
   private:
     glm::vec3 position;
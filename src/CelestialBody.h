@@ -1,57 +1,46 @@
 #pragma once
 
+#include "Mesh.h"
+#include "ParticleStore.h"
 #include "raii.h"
 #include <glm/glm.hpp>
-#include <vector>
-
-struct TrailPoint {
-    glm::vec3 position;
-    float life;
-};
+#include <memory>
+#include <string>
 
+// Render and trail view of one particle; the physical state lives in the
+// ParticleStore at `index`.
 class CelestialBody {
   public:
-    CelestialBody(double mass, const glm::dvec3 &initialPos,
-                  const glm::dvec3 &initialVel, float scale,
+    CelestialBody(const ParticleStore &store, size_t index, float scale,
                   const char *texturePath, const glm::vec3 &trailColor);
     ~CelestialBody() noexcept;
 
-    void updateTrail(float dt);
-
-    const glm::dvec3 &getPosition() const noexcept { return pos_; }
+    glm::dvec3 getPosition() const noexcept { return store_->position(index_); }
+    size_t getIndex() const noexcept { return index_; }
     const glm::vec3 &getTrailColor() const noexcept { return trailColor_; }
     float getScale() const noexcept { return scale_; }
+    const std::string &getTexturePath() const noexcept {
+        return texturePath_;
+    }
 
     void bindMeshAndTexture() const noexcept;
     void drawMesh() const noexcept;
-    void drawTrail() const noexcept;
 
-    double getMass() const noexcept { return mass_; }
-    glm::dvec3 getVelocity() const noexcept { return vel_; }
-    void setPosition(const glm::dvec3 &p) noexcept { pos_ = p; }
-    void setVelocity(const glm::dvec3 &v) noexcept { vel_ = v; }
+    double getMass() const noexcept { return store_->m[index_]; }
+    glm::dvec3 getVelocity() const noexcept {
+        return store_->velocity(index_);
+    }
 
   private:
-    double mass_;
-    glm::dvec3 pos_, vel_;
+    const ParticleStore *store_;
+    size_t index_;
     float scale_;
 
-    VertexArray sphereVAO_;
-    Buffer sphereVBO_, sphereEBO_;
-    Texture2D texture_;
-    GLsizei indexCount_;
+    std::shared_ptr<const Mesh> sphere_;
+    // Loaded on the first bind: the instanced path reads the renderer's
+    // texture array and never needs it.
+    mutable std::shared_ptr<const Texture2D> texture_;
+    std::string texturePath_;
 
-    VertexArray trailVAO_;
-    Buffer trailVBO_;
-    std::vector<float> trailData_;
-
-    static constexpr size_t MAX_TRAILS = 1000;
-    RingBuffer<TrailPoint, MAX_TRAILS> trail_;
-    float sampleAcc_ = 0.0f;
     glm::vec3 trailColor_;
-
-    void initMesh();
-    void initTrail();
-    void rebuildTrailBuffer();
-    unsigned loadTexture(const char *path) noexcept;
 };
@@ -0,0 +1,350 @@
+#include "Checkpoint.h"
+#include "Endian.h"
+#include "Profiler.h"
+
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+constexpr char MAGIC[8] = {'S', 'P', 'T', 'M', 'C', 'K', 'P', 'T'};
+constexpr size_t HEADER_BYTES = 128;
+constexpr size_t ALIGN = 64;
+constexpr size_t ARRAYS = 7;
+
+// Header::flags bits.
+constexpr uint32_t GPU_RESIDENT = 1;
+constexpr uint32_t TILED_KERNEL = 2;
+constexpr uint32_t BLOCK_TIMESTEPS = 4;
+constexpr uint32_t QUADRUPOLE = 8;
+constexpr uint32_t MESH_SHORT_RANGE = 16;
+
+// Every field little-endian. Enums are stored as their values, so
+// reordering ForceBackend, Integrator or MassAssignment needs a new
+// VERSION.
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerBytes;
+    uint64_t count;
+    uint64_t sectionBytes; // per array, a multiple of ALIGN
+    double time;
+    uint64_t steps;
+    double dt;
+    double theta;
+    uint32_t backend;
+    uint32_t integrator;
+    uint32_t assignment;
+    int32_t meshGrid;
+    uint32_t flags;
+    uint8_t reserved[HEADER_BYTES - 84];
+};
+static_assert(sizeof(Header) == HEADER_BYTES);
+
+// Copies n doubles to or from their little-endian file form.
+void copyLittle(void *dst, const void *src, size_t n) noexcept {
+    if constexpr (std::endian::native == std::endian::little) {
+        std::memcpy(dst, src, n * sizeof(double));
+    } else {
+        auto *d = static_cast<std::byte *>(dst);
+        auto *s = static_cast<const std::byte *>(src);
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t v;
+            std::memcpy(&v, s + i * sizeof v, sizeof v);
+            v = std::byteswap(v);
+            std::memcpy(d + i * sizeof v, &v, sizeof v);
+        }
+    }
+}
+
+// The stored arrays, in file order.
+template <class Store> auto arrays(Store &s) {
+    return std::array{&s.px, &s.py, &s.pz, &s.vx, &s.vy, &s.vz, &s.m};
+}
+
+// Read-only view of a whole file. The descriptor is closed once mapped.
+class MappedFile {
+  public:
+    explicit MappedFile(const std::string &path) {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ,
+                                  FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("cannot open checkpoint " + path);
+        LARGE_INTEGER size{};
+        GetFileSizeEx(file, &size);
+        size_ = size_t(size.QuadPart);
+        if (size_ > 0) {
+            if (HANDLE mapping = CreateFileMappingA(file, nullptr,
+                                                    PAGE_READONLY, 0, 0,
+                                                    nullptr)) {
+                data_ = static_cast<const std::byte *>(
+                    MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("cannot open checkpoint " + path);
+        struct stat st{};
+        ::fstat(fd, &st);
+        size_ = size_t(st.st_size);
+        if (size_ > 0) {
+            void *p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                ::madvise(p, size_, MADV_SEQUENTIAL);
+                data_ = static_cast<const std::byte *>(p);
+            }
+        }
+        ::close(fd);
+#endif
+        if (size_ > 0 && !data_)
+            throw std::runtime_error("cannot map checkpoint " + path);
+    }
+
+    ~MappedFile() noexcept {
+        if (!data_)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(data_);
+#else
+        ::munmap(const_cast<std::byte *>(data_), size_);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const std::byte *data() const noexcept { return data_; }
+    size_t size() const noexcept { return size_; }
+
+  private:
+    const std::byte *data_ = nullptr;
+    size_t size_ = 0;
+};
+} // namespace
+
+namespace Checkpoint {
+Settings capture(PhysicsEngine &engine, double time, uint64_t steps,
+                 double dt) {
+    Settings s;
+    s.time = time;
+    s.steps = steps;
+    s.dt = dt;
+    s.backend = engine.getBackend();
+    s.integrator = engine.getIntegrator();
+    s.gpuResident = engine.getGpuResident();
+    s.tiledKernel = engine.getTiledKernel();
+    s.blockTimesteps = engine.getBlockTimesteps();
+    s.theta = engine.getBarnesHut().getTheta();
+    s.quadrupole = engine.getBarnesHut().getQuadrupole();
+    s.meshGrid = engine.getParticleMesh().getGridSize();
+    s.assignment = engine.getParticleMesh().getAssignment();
+    s.meshShortRange = engine.getParticleMesh().getShortRange();
+    return s;
+}
+
+void apply(const Settings &s, PhysicsEngine &engine) {
+    engine.setBackend(s.backend);
+    engine.setIntegrator(s.integrator);
+    engine.setGpuResident(s.gpuResident);
+    engine.setTiledKernel(s.tiledKernel);
+    engine.setBlockTimesteps(s.blockTimesteps);
+    engine.getBarnesHut().setTheta(s.theta);
+    engine.getBarnesHut().setQuadrupole(s.quadrupole);
+    engine.getParticleMesh().setGridSize(s.meshGrid);
+    engine.getParticleMesh().setAssignment(s.assignment);
+    engine.getParticleMesh().setShortRange(s.meshShortRange);
+}
+
+std::vector<std::byte> encode(const ParticleStore &store,
+                              const Settings &s) {
+    size_t n = store.size();
+    size_t section = (n * sizeof(double) + ALIGN - 1) / ALIGN * ALIGN;
+
+    Header h{};
+    std::memcpy(h.magic, MAGIC, sizeof MAGIC);
+    h.version = little(VERSION);
+    h.headerBytes = little(uint32_t(HEADER_BYTES));
+    h.count = little(uint64_t(n));
+    h.sectionBytes = little(uint64_t(section));
+    h.time = little(s.time);
+    h.steps = little(s.steps);
+    h.dt = little(s.dt);
+    h.theta = little(s.theta);
+    h.backend = little(uint32_t(s.backend));
+    h.integrator = little(uint32_t(s.integrator));
+    h.assignment = little(uint32_t(s.assignment));
+    h.meshGrid = little(int32_t(s.meshGrid));
+    h.flags = little((s.gpuResident ? GPU_RESIDENT : 0) |
+                     (s.tiledKernel ? TILED_KERNEL : 0) |
+                     (s.blockTimesteps ? BLOCK_TIMESTEPS : 0) |
+                     (s.quadrupole ? QUADRUPOLE : 0) |
+                     (s.meshShortRange ? MESH_SHORT_RANGE : 0));
+
+    std::vector<std::byte> image(HEADER_BYTES + ARRAYS * section);
+    std::memcpy(image.data(), &h, sizeof h);
+    std::byte *out = image.data() + HEADER_BYTES;
+    for (const AlignedVector<double> *a : arrays(store)) {
+        copyLittle(out, a->data(), n);
+        out += section;
+    }
+    return image;
+}
+
+void write(const std::string &path, const std::vector<std::byte> &image) {
+    std::string tmp = path + ".tmp";
+    std::FILE *f = std::fopen(tmp.c_str(), "wb");
+    if (!f)
+        throw std::runtime_error("cannot write checkpoint " + tmp);
+    bool ok = std::fwrite(image.data(), 1, image.size(), f) == image.size();
+    ok = std::fclose(f) == 0 && ok;
+
+    std::error_code ec;
+    if (ok)
+        std::filesystem::rename(tmp, path, ec);
+    if (!ok || ec) {
+        std::filesystem::remove(tmp, ec);
+        throw std::runtime_error("cannot write checkpoint " + path);
+    }
+}
+
+Settings load(const std::string &path, ParticleStore &store) {
+    PROFILE_ZONE("Checkpoint::load");
+    MappedFile file(path);
+    Header h;
+    if (file.size() < sizeof h)
+        throw std::runtime_error(path + " is not a checkpoint");
+    std::memcpy(&h, file.data(), sizeof h);
+    if (std::memcmp(h.magic, MAGIC, sizeof MAGIC) != 0)
+        throw std::runtime_error(path + " is not a checkpoint");
+    if (uint32_t v = little(h.version); v != VERSION)
+        throw std::runtime_error(path + " is checkpoint version " +
+                                 std::to_string(v) + ", expected " +
+                                 std::to_string(VERSION));
+
+    size_t headerBytes = little(h.headerBytes);
+    uint64_t n = little(h.count);
+    uint64_t section = little(h.sectionBytes);
+    Settings s;
+    s.time = little(h.time);
+    s.steps = little(h.steps);
+    s.dt = little(h.dt);
+    s.theta = little(h.theta);
+    uint32_t backend = little(h.backend);
+    uint32_t integrator = little(h.integrator);
+    uint32_t assignment = little(h.assignment);
+    s.meshGrid = little(h.meshGrid);
+    uint32_t flags = little(h.flags);
+
+    if (!(s.dt > 0.0) || headerBytes < HEADER_BYTES ||
+        headerBytes % ALIGN != 0 ||
+        headerBytes > file.size() || section % ALIGN != 0 ||
+        n > section / sizeof(double) ||
+        section > (file.size() - headerBytes) / ARRAYS ||
+        backend > uint32_t(ForceBackend::ParticleMesh) ||
+        integrator >= Integrators::TABLE.size() ||
+        assignment > uint32_t(MassAssignment::TSC))
+        throw std::runtime_error(path + " is truncated or corrupt");
+
+    s.backend = ForceBackend(backend);
+    s.integrator = Integrator(integrator);
+    s.assignment = MassAssignment(assignment);
+    s.gpuResident = flags & GPU_RESIDENT;
+    s.tiledKernel = flags & TILED_KERNEL;
+    s.blockTimesteps = flags & BLOCK_TIMESTEPS;
+    s.quadrupole = flags & QUADRUPOLE;
+    s.meshShortRange = flags & MESH_SHORT_RANGE;
+
+    store.clear();
+    store.resize(n);
+    const std::byte *in = file.data() + headerBytes;
+    for (AlignedVector<double> *a : arrays(store)) {
+        copyLittle(a->data(), in, n);
+        in += section;
+    }
+    return s;
+}
+
+Writer::Writer() : thread_{[this] { loop(); }} {}
+
+Writer::~Writer() noexcept {
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+}
+
+void Writer::submit(std::string path, std::vector<std::byte> image) {
+    {
+        std::lock_guard lock(mutex_);
+        pending_ = Job{std::move(path), std::move(image)};
+    }
+    wake_.notify_one();
+}
+
+bool Writer::busy() const {
+    std::lock_guard lock(mutex_);
+    return writing_ || pending_.has_value();
+}
+
+void Writer::status(std::string &out) const {
+    std::lock_guard lock(mutex_);
+    out.assign(status_);
+}
+
+void Writer::loop() {
+    Profiler::setThreadName("checkpoint");
+    std::unique_lock lock(mutex_);
+    for (;;) {
+        wake_.wait(lock, [this] { return pending_ || stopping_; });
+        if (!pending_)
+            return;
+        Job job = std::move(*pending_);
+        pending_.reset();
+        writing_ = true;
+        lock.unlock();
+
+        std::string status;
+        auto begin = std::chrono::steady_clock::now();
+        try {
+            PROFILE_ZONE("Checkpoint::write");
+            write(job.path, job.image);
+            double ms = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - begin)
+                            .count();
+            char buf[256];
+            std::snprintf(buf, sizeof(buf), "%s: %.1f MB in %.0f ms",
+                          job.path.c_str(), double(job.image.size()) / 1e6,
+                          ms);
+            status = buf;
+        } catch (const std::exception &e) {
+            status = e.what();
+        }
+
+        lock.lock();
+        writing_ = false;
+        status_ = std::move(status);
+    }
+}
+} // namespace Checkpoint
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Integrators.h"
+#include "PhysicsEngine.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Versioned binary snapshot of a simulation: a little-endian 128-byte
+// header, then positions, velocities and masses as seven 64-byte-aligned
+// arrays of doubles in ParticleStore order. Loading maps the file and
+// copies each array straight into a ParticleStore, so restarting costs
+// about as much as reading the file once.
+//
+//     offset 0                   Header
+//     128 + k * sectionBytes     px, py, pz, vx, vy, vz, m  (k = 0..6)
+//
+// Accelerations and block-timestep levels aren't stored; the engine
+// rebuilds them on its next step.
+namespace Checkpoint {
+constexpr uint32_t VERSION = 1;
+
+// Everything besides the bodies needed to continue a run.
+struct Settings {
+    double time = 0.0;
+    uint64_t steps = 0;
+    double dt = 0.01;
+    ForceBackend backend = ForceBackend::GpuDirect;
+    Integrator integrator = Integrator::Yoshida4;
+    bool gpuResident = false;
+    bool tiledKernel = true;
+    bool blockTimesteps = false;
+    double theta = 0.5;
+    bool quadrupole = true;
+    int meshGrid = 32;
+    MassAssignment assignment = MassAssignment::TSC;
+    bool meshShortRange = false;
+};
+
+// Settings of `engine` for a run at `time` after `steps` steps of `dt`.
+Settings capture(PhysicsEngine &engine, double time, uint64_t steps,
+                 double dt);
+void apply(const Settings &settings, PhysicsEngine &engine);
+
+// Builds the complete file image in memory, one copy per array, so the
+// caller's thread only pays for the copy and a Writer does the I/O.
+std::vector<std::byte> encode(const ParticleStore &store,
+                              const Settings &settings);
+
+// Writes `image` to a temporary file renamed over `path`, so a crash
+// mid-write leaves the previous checkpoint intact. Throws
+// std::runtime_error on I/O failure.
+void write(const std::string &path, const std::vector<std::byte> &image);
+
+// Maps `path` and replaces the contents of `store` with its bodies.
+// Throws std::runtime_error if the file is unreadable, truncated or of
+// another version.
+Settings load(const std::string &path, ParticleStore &store);
+
+// Writes images on a background thread. A newer image for a write still
+// queued replaces it; the destructor finishes what is queued.
+class Writer {
+  public:
+    Writer();
+    ~Writer() noexcept;
+
+    Writer(const Writer &) = delete;
+    Writer &operator=(const Writer &) = delete;
+
+    void submit(std::string path, std::vector<std::byte> image);
+
+    bool busy() const;
+    // Copies the outcome of the last finished write into `out`, reusing its
+    // storage; empty before the first.
+    void status(std::string &out) const;
+
+  private:
+    struct Job {
+        std::string path;
+        std::vector<std::byte> image;
+    };
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::optional<Job> pending_;
+    bool writing_ = false;
+    bool stopping_ = false;
+    std::string status_;
+    std::thread thread_;
+
+    void loop();
+};
+} // namespace Checkpoint
@@ -3,11 +3,23 @@
 #include <sstream>
 #include <stdexcept>
 
-ComputeShader::ComputeShader(const char *path) {
+ComputeShader::ComputeShader(
+    const char *path, const std::vector<std::pair<std::string, int>> &defines) {
     std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error("Failed to open compute shader " +
+                                 std::string(path));
     std::stringstream ss;
     ss << file.rdbuf();
     std::string src = ss.str();
+
+    if (!defines.empty()) {
+        std::string block;
+        for (const auto &[name, value] : defines)
+            block += "#define " + name + " " + std::to_string(value) + "\n";
+        size_t eol = src.find('\n', src.find("#version"));
+        src.insert(eol == std::string::npos ? src.size() : eol + 1, block);
+    }
     const char *csrc = src.c_str();
 
     GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
@@ -19,6 +31,7 @@ ComputeShader::ComputeShader(const char *path) {
     if (!success) {
         char log[512];
         glGetShaderInfoLog(shader, 512, nullptr, log);
+        glDeleteShader(shader);
         throw std::runtime_error("Compute shader compilation failed: " +
                                  std::string(log));
     }
@@ -27,11 +40,29 @@ ComputeShader::ComputeShader(const char *path) {
     glAttachShader(program_, shader);
     glLinkProgram(program_);
     glDeleteShader(shader);
+
+    glGetProgramiv(program_, GL_LINK_STATUS, &success);
+    if (!success) {
+        char log[512];
+        glGetProgramInfoLog(program_, 512, nullptr, log);
+        glDeleteProgram(program_);
+        throw std::runtime_error("Compute shader link failed: " +
+                                 std::string(log));
+    }
+
+    GLint size[3];
+    glGetProgramiv(program_, GL_COMPUTE_WORK_GROUP_SIZE, size);
+    localSize_ = size[0];
+}
+
+ComputeShader::~ComputeShader() noexcept {
+    if (program_)
+        glDeleteProgram(program_);
 }
 
 void ComputeShader::bind() const { glUseProgram(program_); }
 
 void ComputeShader::dispatch(int count) {
-    glDispatchCompute((count + 127) / 128, 1, 1);
+    glDispatchCompute((count + localSize_ - 1) / localSize_, 1, 1);
     glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 }
@@ -1,14 +1,26 @@
 #pragma once
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <string>
+#include <utility>
+#include <vector>
 
 class ComputeShader {
   public:
-    ComputeShader(const char *path);
+    // `defines` are injected as `#define NAME VALUE` right after #version.
+    ComputeShader(const char *path,
+                  const std::vector<std::pair<std::string, int>> &defines = {});
+    ~ComputeShader() noexcept;
+
+    ComputeShader(const ComputeShader &) = delete;
+    ComputeShader &operator=(const ComputeShader &) = delete;
+
     void dispatch(int count);
     void bind() const;
     GLuint id() const { return program_; }
+    GLint localSize() const { return localSize_; }
 
   private:
     GLuint program_{};
+    GLint localSize_ = 128;
 };
@@ -0,0 +1,186 @@
+#include "DirectSum.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                             \
+    (defined(__GNUC__) || defined(__clang__))
+#define SPACETIME_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace {
+constexpr size_t TARGET_BLOCK = 64;
+constexpr size_t SOURCE_TILE = 2048;
+
+void kernelScalar(const DirectSum::Sources &s, size_t jBegin, size_t jEnd,
+                  double xi, double yi, double zi, double G, double softening,
+                  double *out) {
+    double ax = 0.0, ay = 0.0, az = 0.0;
+    for (size_t j = jBegin; j < jEnd; ++j) {
+        double dx = s.x[j] - xi;
+        double dy = s.y[j] - yi;
+        double dz = s.z[j] - zi;
+        double distSqr = dx * dx + dy * dy + dz * dz + softening;
+        double invDist = 1.0 / std::sqrt(distSqr);
+        double f = G * s.m[j] * invDist * invDist * invDist;
+        ax += dx * f;
+        ay += dy * f;
+        az += dz * f;
+    }
+    out[0] += ax;
+    out[1] += ay;
+    out[2] += az;
+}
+
+#ifdef SPACETIME_X86_SIMD
+__attribute__((target("avx2,fma"))) void
+kernelAvx2(const DirectSum::Sources &s, size_t jBegin, size_t jEnd, double xi,
+           double yi, double zi, double G, double softening, double *out) {
+    const __m256d vxi = _mm256_set1_pd(xi);
+    const __m256d vyi = _mm256_set1_pd(yi);
+    const __m256d vzi = _mm256_set1_pd(zi);
+    const __m256d veps = _mm256_set1_pd(softening);
+    const __m256d vG = _mm256_set1_pd(G);
+    const __m256d one = _mm256_set1_pd(1.0);
+    __m256d ax = _mm256_setzero_pd();
+    __m256d ay = _mm256_setzero_pd();
+    __m256d az = _mm256_setzero_pd();
+
+    for (size_t j = jBegin; j < jEnd; j += 4) {
+        __m256d dx = _mm256_sub_pd(_mm256_load_pd(s.x + j), vxi);
+        __m256d dy = _mm256_sub_pd(_mm256_load_pd(s.y + j), vyi);
+        __m256d dz = _mm256_sub_pd(_mm256_load_pd(s.z + j), vzi);
+        __m256d r2 = _mm256_fmadd_pd(
+            dx, dx, _mm256_fmadd_pd(dy, dy, _mm256_fmadd_pd(dz, dz, veps)));
+        __m256d invDist = _mm256_div_pd(one, _mm256_sqrt_pd(r2));
+        __m256d invDist3 =
+            _mm256_mul_pd(invDist, _mm256_mul_pd(invDist, invDist));
+        __m256d f =
+            _mm256_mul_pd(_mm256_mul_pd(vG, _mm256_load_pd(s.m + j)), invDist3);
+        ax = _mm256_fmadd_pd(dx, f, ax);
+        ay = _mm256_fmadd_pd(dy, f, ay);
+        az = _mm256_fmadd_pd(dz, f, az);
+    }
+
+    alignas(32) double lanes[3][4];
+    _mm256_store_pd(lanes[0], ax);
+    _mm256_store_pd(lanes[1], ay);
+    _mm256_store_pd(lanes[2], az);
+    for (int c = 0; c < 3; ++c)
+        out[c] += (lanes[c][0] + lanes[c][1]) + (lanes[c][2] + lanes[c][3]);
+}
+
+__attribute__((target("avx512f"))) void
+kernelAvx512(const DirectSum::Sources &s, size_t jBegin, size_t jEnd, double xi,
+             double yi, double zi, double G, double softening, double *out) {
+    const __m512d vxi = _mm512_set1_pd(xi);
+    const __m512d vyi = _mm512_set1_pd(yi);
+    const __m512d vzi = _mm512_set1_pd(zi);
+    const __m512d veps = _mm512_set1_pd(softening);
+    const __m512d vG = _mm512_set1_pd(G);
+    const __m512d one = _mm512_set1_pd(1.0);
+    __m512d ax = _mm512_setzero_pd();
+    __m512d ay = _mm512_setzero_pd();
+    __m512d az = _mm512_setzero_pd();
+
+    for (size_t j = jBegin; j < jEnd; j += 8) {
+        __m512d dx = _mm512_sub_pd(_mm512_load_pd(s.x + j), vxi);
+        __m512d dy = _mm512_sub_pd(_mm512_load_pd(s.y + j), vyi);
+        __m512d dz = _mm512_sub_pd(_mm512_load_pd(s.z + j), vzi);
+        __m512d r2 = _mm512_fmadd_pd(
+            dx, dx, _mm512_fmadd_pd(dy, dy, _mm512_fmadd_pd(dz, dz, veps)));
+        __m512d invDist = _mm512_div_pd(one, _mm512_sqrt_pd(r2));
+        __m512d invDist3 =
+            _mm512_mul_pd(invDist, _mm512_mul_pd(invDist, invDist));
+        __m512d f =
+            _mm512_mul_pd(_mm512_mul_pd(vG, _mm512_load_pd(s.m + j)), invDist3);
+        ax = _mm512_fmadd_pd(dx, f, ax);
+        ay = _mm512_fmadd_pd(dy, f, ay);
+        az = _mm512_fmadd_pd(dz, f, az);
+    }
+
+    out[0] += _mm512_reduce_add_pd(ax);
+    out[1] += _mm512_reduce_add_pd(ay);
+    out[2] += _mm512_reduce_add_pd(az);
+}
+#endif
+
+DirectSum::Kernel selectKernel() noexcept {
+#ifdef SPACETIME_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return kernelAvx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return kernelAvx2;
+#endif
+    return kernelScalar;
+}
+
+const DirectSum::Kernel activeKernel = selectKernel();
+} // namespace
+
+const char *DirectSum::isaName() noexcept {
+#ifdef SPACETIME_X86_SIMD
+    if (activeKernel == kernelAvx512)
+        return "AVX-512";
+    if (activeKernel == kernelAvx2)
+        return "AVX2";
+#endif
+    return "scalar";
+}
+
+namespace {
+// Tiles targets[0, count) against every source; target(k) maps a slot to a
+// body index.
+template <class TargetFn>
+void accumulate(ParticleStore &store, size_t count, TargetFn target,
+                double G, double softening) {
+    // The store pads to a whole vector with massless particles at the origin;
+    // softening keeps them finite and zero mass makes them contribute nothing.
+    size_t padded = store.paddedSize();
+    const DirectSum::Sources src{store.px.data(), store.py.data(),
+                                 store.pz.data(), store.m.data()};
+    double *ax = store.ax.data();
+    double *ay = store.ay.data();
+    double *az = store.az.data();
+
+    ThreadPool::shared().parallelFor(
+        count, TARGET_BLOCK, [&](size_t begin, size_t end) {
+            double acc[TARGET_BLOCK][3] = {};
+            for (size_t jt = 0; jt < padded; jt += SOURCE_TILE) {
+                size_t jEnd = std::min(jt + SOURCE_TILE, padded);
+                for (size_t k = begin; k < end; ++k) {
+                    size_t i = target(k);
+                    activeKernel(src, jt, jEnd, src.x[i], src.y[i], src.z[i],
+                                 G, softening, acc[k - begin]);
+                }
+            }
+            for (size_t k = begin; k < end; ++k) {
+                size_t i = target(k);
+                ax[i] = acc[k - begin][0];
+                ay[i] = acc[k - begin][1];
+                az[i] = acc[k - begin][2];
+            }
+        });
+}
+} // namespace
+
+void DirectSum::computeAccelerations(ParticleStore &store, double G,
+                                     double softening) {
+    if (store.empty())
+        return;
+    accumulate(
+        store, store.size(), [](size_t k) { return k; }, G, softening);
+}
+
+void DirectSum::computeAccelerations(ParticleStore &store,
+                                     std::span<const uint32_t> targets,
+                                     double G, double softening) {
+    if (targets.empty())
+        return;
+    accumulate(
+        store, targets.size(), [&](size_t k) { return size_t{targets[k]}; },
+        G, softening);
+}
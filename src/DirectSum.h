@@ -0,0 +1,30 @@
+#pragma once
+
+#include "ParticleStore.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// CPU O(N²) direct sum with the same softened interaction as gravity.comp.
+// Runs tiled over the shared thread pool and picks an AVX-512, AVX2 or
+// scalar kernel at runtime from what the CPU supports.
+class DirectSum {
+  public:
+    // Reads positions and masses straight from the store's padded arrays
+    // and writes ax/ay/az.
+    void computeAccelerations(ParticleStore &store, double G,
+                              double softening);
+    // Same, but only the listed bodies get new accelerations.
+    void computeAccelerations(ParticleStore &store,
+                              std::span<const uint32_t> targets, double G,
+                              double softening);
+
+    static const char *isaName() noexcept;
+
+    struct Sources {
+        const double *x, *y, *z, *m;
+    };
+    using Kernel = void (*)(const Sources &src, size_t jBegin, size_t jEnd,
+                            double xi, double yi, double zi, double G,
+                            double softening, double *out);
+};
@@ -0,0 +1,79 @@
+#include "EglContext.h"
+
+#include <stdexcept>
+
+#ifdef SPACETIME_HAS_EGL
+#include <glad/glad.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+bool EglContext::available() noexcept { return true; }
+
+EglContext::EglContext() {
+    // Prefer Mesa's surfaceless platform so no X or Wayland server is needed.
+    EGLDisplay display = EGL_NO_DISPLAY;
+    auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+        eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (getPlatformDisplay)
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                     EGL_DEFAULT_DISPLAY, nullptr);
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+        throw std::runtime_error("EGL display initialization failed");
+    display_ = display;
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        eglTerminate(display);
+        throw std::runtime_error("EGL does not support desktop OpenGL");
+    }
+
+    const EGLint configAttribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                    EGL_NONE};
+    EGLConfig config = nullptr;
+    EGLint numConfigs = 0;
+    eglChooseConfig(display, configAttribs, &config, 1, &numConfigs);
+
+    const EGLint contextAttribs[] = {EGL_CONTEXT_MAJOR_VERSION,
+                                     4,
+                                     EGL_CONTEXT_MINOR_VERSION,
+                                     5,
+                                     EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                     EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                     EGL_NONE};
+    // With EGL_KHR_no_config_context a null config is fine when none match.
+    EGLContext context = eglCreateContext(
+        display, numConfigs > 0 ? config : nullptr, EGL_NO_CONTEXT,
+        contextAttribs);
+    if (context == EGL_NO_CONTEXT) {
+        eglTerminate(display);
+        throw std::runtime_error("EGL OpenGL 4.5 context creation failed");
+    }
+    context_ = context;
+
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context) ||
+        !gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+        eglDestroyContext(display, context);
+        eglTerminate(display);
+        throw std::runtime_error("EGL surfaceless context activation failed");
+    }
+}
+
+EglContext::~EglContext() {
+    eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display_, context_);
+    eglTerminate(display_);
+}
+
+#else
+
+bool EglContext::available() noexcept { return false; }
+
+EglContext::EglContext() {
+    throw std::runtime_error("built without EGL; use a CPU backend");
+}
+
+EglContext::~EglContext() = default;
+
+#endif
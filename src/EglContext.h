@@ -0,0 +1,20 @@
+#pragma once
+
+// Surfaceless EGL OpenGL context for running the compute backends on
+// machines with no display. Requires EGL_KHR_surfaceless_context (Mesa,
+// NVIDIA); throws std::runtime_error if no 4.5 core context can be made.
+// Only functional when built with SPACETIME_HAS_EGL.
+class EglContext {
+  public:
+    EglContext();
+    ~EglContext();
+
+    EglContext(const EglContext &) = delete;
+    EglContext &operator=(const EglContext &) = delete;
+
+    static bool available() noexcept;
+
+  private:
+    void *display_ = nullptr;
+    void *context_ = nullptr;
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+
+// Converts a 4- or 8-byte value between host order and the little-endian
+// order of the on-disk formats; the identity on little-endian hosts.
+template <class T> T little(T v) noexcept {
+    static_assert(sizeof(T) == 4 || sizeof(T) == 8);
+    if constexpr (std::endian::native == std::endian::little)
+        return v;
+    else if constexpr (sizeof(T) == 8)
+        return std::bit_cast<T>(std::byteswap(std::bit_cast<uint64_t>(v)));
+    else
+        return std::bit_cast<T>(std::byteswap(std::bit_cast<uint32_t>(v)));
+}
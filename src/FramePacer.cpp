@@ -0,0 +1,23 @@
+#include "FramePacer.h"
+#include "Profiler.h"
+#include "raii.h"
+
+FramePacer::~FramePacer() noexcept {
+    for (GLsync &sync : fences_)
+        if (sync)
+            glDeleteSync(sync);
+}
+
+void FramePacer::beginFrame() noexcept {
+    PROFILE_ZONE("FramePacer::beginFrame");
+    int64_t begin = Profiler::now();
+    waitAndDeleteSync(fences_[frame_ % MAX_FRAMES_IN_FLIGHT]);
+    waitMs_ = float(double(Profiler::now() - begin) * 1e-6);
+}
+
+void FramePacer::endFrame() noexcept {
+    fences_[frame_ % MAX_FRAMES_IN_FLIGHT] =
+        glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    ++frame_;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <array>
+#include <cstdint>
+
+// Keeps the render thread at most MAX_FRAMES_IN_FLIGHT frames ahead of the
+// GPU with a ring of per-frame fences. The CPU prepares frame k (snapshot
+// interpolation, well refinement, ImGui) while the GPU still works through
+// frame k - 1, and physics steps on its own thread and context regardless,
+// so CPU and GPU overlap rather than alternate. Bounding the queue also
+// bounds input latency and keeps StreamBuffer rings from ever blocking.
+class FramePacer {
+  public:
+    static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+
+    FramePacer() = default;
+    ~FramePacer() noexcept;
+
+    FramePacer(const FramePacer &) = delete;
+    FramePacer &operator=(const FramePacer &) = delete;
+
+    // Waits for the GPU to finish the frame that last used this slot.
+    void beginFrame() noexcept;
+    // Fences and flushes everything submitted since beginFrame().
+    void endFrame() noexcept;
+
+    // Time the last beginFrame() blocked; persistently above zero means
+    // the GPU is the bottleneck.
+    float waitMs() const noexcept { return waitMs_; }
+
+  private:
+    std::array<GLsync, MAX_FRAMES_IN_FLIGHT> fences_{};
+    uint64_t frame_ = 0;
+    float waitMs_ = 0.0f;
+};
@@ -0,0 +1,90 @@
+#include "GpuTimers.h"
+
+#include <algorithm>
+
+GpuTimers::GpuTimers() {
+    for (auto &frame : slots_)
+        for (Slot &s : frame) {
+            glGenQueries(1, &s.time);
+            glGenQueries(1, &s.primitives);
+        }
+}
+
+GpuTimers::~GpuTimers() noexcept {
+    for (auto &frame : slots_)
+        for (Slot &s : frame) {
+            glDeleteQueries(1, &s.time);
+            glDeleteQueries(1, &s.primitives);
+        }
+}
+
+const char *GpuTimers::name(Pass pass) noexcept {
+    switch (pass) {
+    case Compute:
+        return "Compute";
+    case Well:
+        return "Well";
+    case Meshes:
+        return "Meshes";
+    case Trails:
+        return "Trails";
+    case Ui:
+        return "ImGui";
+    case Gravity:
+        return "Gravity";
+    case Resident:
+        return "Resident step";
+    case PASS_COUNT:
+        break;
+    }
+    return "?";
+}
+
+void GpuTimers::collect(Pass pass, Slot &slot) noexcept {
+    if (!slot.issued)
+        return;
+    slot.issued = false;
+
+    // The time query ends last, so once it is available both are.
+    GLuint available = 0;
+    glGetQueryObjectuiv(slot.time, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return;
+
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(slot.time, GL_QUERY_RESULT, &ns);
+    Stats &s = stats_[pass];
+    glGetQueryObjectuiv(slot.primitives, GL_QUERY_RESULT, &s.primitives);
+    s.lastMs = float(double(ns) * 1e-6);
+    s.history[s.head] = s.lastMs;
+    s.head = (s.head + 1) % HISTORY;
+    s.samples = std::min(s.samples + 1, HISTORY);
+}
+
+void GpuTimers::beginFrame() noexcept {
+    ++frame_;
+    for (int p = 0; p < PASS_COUNT; ++p)
+        collect(Pass(p), current(Pass(p)));
+}
+
+void GpuTimers::begin(Pass pass) noexcept {
+    Slot &slot = current(pass);
+    glBeginQuery(GL_PRIMITIVES_GENERATED, slot.primitives);
+    glBeginQuery(GL_TIME_ELAPSED, slot.time);
+}
+
+void GpuTimers::end(Pass pass) noexcept {
+    glEndQuery(GL_PRIMITIVES_GENERATED);
+    glEndQuery(GL_TIME_ELAPSED);
+    current(pass).issued = true;
+}
+
+float GpuTimers::averageMs(Pass pass) const noexcept {
+    const Stats &s = stats_[pass];
+    if (s.samples == 0)
+        return 0.0f;
+    float sum = 0.0f;
+    for (int i = 0; i < s.samples; ++i)
+        sum += s.history[(s.head - 1 - i + HISTORY) % HISTORY];
+    return sum / float(s.samples);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <array>
+#include <cstdint>
+
+// GPU time and primitive count per pass from a ring of GL_TIME_ELAPSED /
+// GL_PRIMITIVES_GENERATED queries. Results are collected FRAMES frames
+// after they were issued, and only if the GPU already has them, so reading
+// never stalls the CPU; a sample that is still pending by then is dropped.
+class GpuTimers {
+  public:
+    // The render thread times Compute to Ui. The physics thread keeps its
+    // own ring, in its own context, for gravity dispatches and whole
+    // GPU-resident steps, each of which is a frame there.
+    enum Pass {
+        Compute,
+        Well,
+        Meshes,
+        Trails,
+        Ui,
+        Gravity,
+        Resident,
+        PASS_COUNT
+    };
+    static constexpr int RENDER_PASSES = Gravity;
+    static constexpr int FRAMES = 4;
+    static constexpr int HISTORY = 120;
+
+    GpuTimers();
+    ~GpuTimers() noexcept;
+
+    GpuTimers(const GpuTimers &) = delete;
+    GpuTimers &operator=(const GpuTimers &) = delete;
+
+    // Collects whatever the slot about to be reused has finished, then
+    // starts recording into it.
+    void beginFrame() noexcept;
+    // Passes must not nest.
+    void begin(Pass pass) noexcept;
+    void end(Pass pass) noexcept;
+
+    static const char *name(Pass pass) noexcept;
+
+    float lastMs(Pass pass) const noexcept { return stats_[pass].lastMs; }
+    float averageMs(Pass pass) const noexcept;
+    GLuint primitives(Pass pass) const noexcept {
+        return stats_[pass].primitives;
+    }
+    // Oldest first when read from historyOffset() onwards, for
+    // ImGui::PlotHistogram.
+    const float *history(Pass pass) const noexcept {
+        return stats_[pass].history.data();
+    }
+    int historyOffset(Pass pass) const noexcept { return stats_[pass].head; }
+
+  private:
+    struct Slot {
+        GLuint time = 0, primitives = 0;
+        bool issued = false;
+    };
+    struct Stats {
+        float lastMs = 0.0f;
+        GLuint primitives = 0;
+        std::array<float, HISTORY> history{};
+        int head = 0, samples = 0;
+    };
+
+    std::array<std::array<Slot, PASS_COUNT>, FRAMES> slots_;
+    std::array<Stats, PASS_COUNT> stats_;
+    uint64_t frame_ = 0;
+
+    Slot &current(Pass pass) noexcept {
+        return slots_[frame_ % FRAMES][pass];
+    }
+    void collect(Pass pass, Slot &slot) noexcept;
+};
@@ -0,0 +1,140 @@
+#include "GravityTuner.h"
+#include "ComputeShader.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+namespace GravityTuner {
+
+// Bump when gravity_tiled.comp changes so stale timings are discarded.
+static constexpr const char *KERNEL_VERSION = "gravity_tiled/1";
+static constexpr int BENCH_BODIES = 16384;
+static constexpr int BENCH_REPEATS = 3;
+
+std::vector<std::pair<std::string, int>> defines(const Config &cfg) {
+    return {{"WORKGROUP_SIZE", cfg.workgroupSize},
+            {"TILE_SIZE", cfg.tileSize},
+            {"UNROLL", cfg.unroll}};
+}
+
+static std::string deviceKey() {
+    auto str = [](GLenum name) {
+        auto *s = reinterpret_cast<const char *>(glGetString(name));
+        return std::string(s ? s : "?");
+    };
+    return std::string(KERNEL_VERSION) + "|" + str(GL_VENDOR) + "|" +
+           str(GL_RENDERER) + "|" + str(GL_VERSION);
+}
+
+static bool readCache(const char *path, const std::string &key, Config &out) {
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t tab = line.rfind('\t');
+        if (tab == std::string::npos || line.compare(0, tab, key) != 0 ||
+            tab != key.size())
+            continue;
+        std::istringstream fields(line.substr(tab + 1));
+        Config cfg;
+        if (fields >> cfg.workgroupSize >> cfg.tileSize >> cfg.unroll) {
+            out = cfg;
+            return true;
+        }
+    }
+    return false;
+}
+
+static double timeConfig(const Config &cfg, GLuint query) {
+    ComputeShader shader("shaders/gravity_tiled.comp", defines(cfg));
+    shader.bind();
+    shader.dispatch(BENCH_BODIES); // warm-up
+
+    double best = std::numeric_limits<double>::max();
+    for (int r = 0; r < BENCH_REPEATS; ++r) {
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        shader.dispatch(BENCH_BODIES);
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+        best = std::min(best, static_cast<double>(ns));
+    }
+    return best;
+}
+
+static Config tune() {
+    std::vector<float> posMass(BENCH_BODIES * 4);
+    std::default_random_engine rng{42};
+    std::uniform_real_distribution<float> dist(-50.0f, 50.0f);
+    for (int i = 0; i < BENCH_BODIES; ++i) {
+        posMass[i * 4 + 0] = dist(rng);
+        posMass[i * 4 + 1] = dist(rng);
+        posMass[i * 4 + 2] = dist(rng);
+        posMass[i * 4 + 3] = 100.0f;
+    }
+
+    GLuint buffers[2];
+    glGenBuffers(2, buffers);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffers[0]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, posMass.size() * sizeof(float),
+                 posMass.data(), GL_STATIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, buffers[1]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, posMass.size() * sizeof(float),
+                 nullptr, GL_DYNAMIC_COPY);
+
+    GLint maxInvocations = 0;
+    glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &maxInvocations);
+    GLint maxShared = 0;
+    glGetIntegerv(GL_MAX_COMPUTE_SHARED_MEMORY_SIZE, &maxShared);
+
+    GLuint query;
+    glGenQueries(1, &query);
+
+    Config best;
+    double bestNs = std::numeric_limits<double>::max();
+    for (int wg : {64, 128, 256, 512}) {
+        if (wg > maxInvocations)
+            continue;
+        for (int mult : {1, 2}) {
+            int tile = wg * mult;
+            if (tile * 16 > maxShared)
+                continue;
+            for (int unroll : {1, 4, 8}) {
+                Config cfg{wg, tile, unroll};
+                try {
+                    double ns = timeConfig(cfg, query);
+                    if (ns < bestNs) {
+                        bestNs = ns;
+                        best = cfg;
+                    }
+                } catch (const std::exception &e) {
+                    std::cerr << "Gravity tuner skipped wg=" << wg
+                              << " tile=" << tile << ": " << e.what() << "\n";
+                }
+            }
+        }
+    }
+
+    glDeleteQueries(1, &query);
+    glDeleteBuffers(2, buffers);
+    return best;
+}
+
+Config loadOrTune(const char *cachePath) {
+    std::string key = deviceKey();
+    Config cfg;
+    if (readCache(cachePath, key, cfg))
+        return cfg;
+
+    cfg = tune();
+    std::ofstream out(cachePath, std::ios::app);
+    out << key << '\t' << cfg.workgroupSize << ' ' << cfg.tileSize << ' '
+        << cfg.unroll << '\n';
+    return cfg;
+}
+
+} // namespace GravityTuner
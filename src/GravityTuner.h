@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Startup autotuner for shaders/gravity_tiled.comp. Each candidate
+// workgroup/tile/unroll combination is timed with GL_TIME_ELAPSED on a
+// synthetic body set and the winner is cached per GL renderer.
+namespace GravityTuner {
+struct Config {
+    int workgroupSize = 128;
+    int tileSize = 128;
+    int unroll = 4;
+};
+
+Config loadOrTune(const char *cachePath = "gravity_tuning.cache");
+std::vector<std::pair<std::string, int>> defines(const Config &cfg);
+} // namespace GravityTuner
@@ -1,102 +1,617 @@
 #include "GravityWell.h"
-#include "CelestialBody.h"
+#include "Profiler.h"
 
+#include <algorithm>
 #include <cmath>
-#include <glm/gtc/type_ptr.hpp>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <span>
 
-GravityWell::GravityWell(float size, int resolution)
-    : size_{size}, resolution_{resolution} {
-    setupBuffers();
+namespace {
+// Must match gravitywell.comp.
+constexpr float WELL_SOFTENING = 0.1f;
+constexpr float K = 0.2f;
+constexpr float SCALE = 15.0f;
+constexpr float PI = 3.14159265f;
+
+// Merges are only traded for a split that is clearly worth more.
+constexpr float TRADE_RATIO = 0.5f;
+
+// Grows `buffer` to `bytes` of immutable storage, keeping the first `keep`
+// bytes and filling the rest with `fill`.
+void grow(Buffer &buffer, size_t keep, size_t bytes, GLuint fill) {
+    Buffer grown;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, grown.id);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, bytes, nullptr, 0);
+    glClearBufferData(GL_COPY_WRITE_BUFFER, GL_R32UI, GL_RED_INTEGER,
+                      GL_UNSIGNED_INT, &fill);
+    if (keep > 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer.id);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                            keep);
+    }
+    buffer = std::move(grown);
+}
+
+// Copies consecutive items, `stride` bytes each, from `from` in the copy
+// read buffer to the sorted, unique item indices `at` in the copy write
+// buffer, one copy per run of neighbours.
+void copyRuns(GLintptr from, std::span<const uint32_t> at, size_t stride) {
+    for (size_t k = 0; k < at.size();) {
+        size_t run = 1;
+        while (k + run < at.size() && at[k + run] == at[k] + run)
+            ++run;
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                            from + GLintptr(k * stride),
+                            GLintptr(at[k] * stride),
+                            GLsizeiptr(run * stride));
+        k += run;
+    }
+}
+} // namespace
+
+GravityWell::GravityWell(float size, size_t vertexBudget)
+    : shader_{"shaders/gravitywell.comp"}, size_{size},
+      vertexBudget_{vertexBudget} {
+    locBodies_ = glGetUniformLocation(shader_.id(), "u_Bodies");
+    locVertices_ = glGetUniformLocation(shader_.id(), "u_Vertices");
+    locG_ = glGetUniformLocation(shader_.id(), "u_G");
+
+    nodes_.push_back({0, 0, 0, -1});
+    addCorners(nodes_[0], +1);
+    for (int level = 0; level < MIN_DEPTH; ++level)
+        for (int i = 0, n = int(nodes_.size()); i < n; ++i)
+            if (nodes_[i].child == -1 && nodes_[i].level == level)
+                split(i);
 }
 
 GravityWell::~GravityWell() noexcept = default;
 
-void GravityWell::setupBuffers() noexcept {
-    int N = 2 * resolution_ + 1;
-    int totalLines = 2 * (N - 1) * N;
-    vertexCount_ = totalLines * 2;
+glm::vec2 GravityWell::toWorld(uint32_t x, uint32_t z) const noexcept {
+    return {(float(x) / EXTENT * 2.0f - 1.0f) * size_,
+            (float(z) / EXTENT * 2.0f - 1.0f) * size_};
+}
 
-    cpuBuffer_.resize(vertexCount_ * 3);
-    yGrid_.resize(N * N);
+size_t GravityWell::CornerMap::home(uint64_t k) const noexcept {
+    uint64_t h = k * 0x9E3779B97F4A7C15ull;
+    return size_t(h ^ (h >> 32)) & (slots_.size() - 1);
+}
 
-    glBindVertexArray(vao_.id);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_.id);
-    glBufferData(GL_ARRAY_BUFFER, cpuBuffer_.size() * sizeof(float), nullptr,
-                 GL_DYNAMIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), nullptr);
-    glEnableVertexAttribArray(0);
-    glBindVertexArray(0);
-}
-
-void GravityWell::updateFromBodies(const std::vector<CelestialBody *> &bodies,
-                                   float G) noexcept {
-    int N = 2 * resolution_ + 1;
-    float step = size_ / resolution_;
-
-    for (int j = 0; j < N; ++j) {
-        for (int i = 0; i < N; ++i) {
-            float x = (i - resolution_) * step;
-            float z = (j - resolution_) * step;
-            float rawY = 0.0f;
-            for (auto *b : bodies) {
-                auto pos = b->getPosition();
-                float dx = x - float(pos.x);
-                float dz = z - float(pos.z);
-                float d = std::sqrt(dx * dx + dz * dz + 0.1f);
-                rawY += -G * float(b->getMass()) / d;
+size_t GravityWell::CornerMap::probe(uint64_t k) const noexcept {
+    size_t mask = slots_.size() - 1;
+    size_t i = home(k);
+    while (slots_[i].key != k && slots_[i].key != EMPTY)
+        i = (i + 1) & mask;
+    return i;
+}
+
+void GravityWell::CornerMap::grow() {
+    std::vector<Entry> old = std::move(slots_);
+    slots_.assign(std::max<size_t>(64, 2 * old.size()), Entry{});
+    for (const Entry &e : old)
+        if (e.key != EMPTY)
+            slots_[probe(e.key)] = e;
+}
+
+GravityWell::CornerMap::Entry &
+GravityWell::CornerMap::acquire(uint64_t k) {
+    if (2 * (size_ + 1) > slots_.size())
+        grow();
+    Entry &e = slots_[probe(k)];
+    if (e.key == EMPTY) {
+        e = {k, 0, 0};
+        ++size_;
+    }
+    ++e.refs;
+    return e;
+}
+
+void GravityWell::CornerMap::release(uint64_t k) noexcept {
+    size_t i = probe(k);
+    if (--slots_[i].refs > 0)
+        return;
+
+    // Shift later entries of the probe run back over the hole unless that
+    // would move them before their home slot.
+    size_t mask = slots_.size() - 1;
+    for (size_t j = (i + 1) & mask; slots_[j].key != EMPTY;
+         j = (j + 1) & mask) {
+        size_t h = home(slots_[j].key);
+        if (((j - h) & mask) < ((j - i) & mask))
+            continue;
+        slots_[i] = slots_[j];
+        i = j;
+    }
+    slots_[i] = Entry{};
+    --size_;
+}
+
+const GravityWell::CornerMap::Entry *
+GravityWell::CornerMap::find(uint64_t k) const noexcept {
+    if (slots_.empty())
+        return nullptr;
+    const Entry &e = slots_[probe(k)];
+    return e.key == k ? &e : nullptr;
+}
+
+// A corner takes a vertex slot when its first leaf arrives and frees it
+// when its last one goes.
+void GravityWell::addCorners(const Node &n, int delta) {
+    uint32_t s = span(n);
+    for (uint64_t k : {key(n.x, n.z), key(n.x + s, n.z), key(n.x, n.z + s),
+                       key(n.x + s, n.z + s)}) {
+        if (delta < 0) {
+            const CornerMap::Entry *e = corners_.find(k);
+            if (e->refs == 1) {
+                slotKeys_[e->vertex] = CornerMap::EMPTY;
+                freeSlots_.push_back(e->vertex);
             }
-            yGrid_[j * N + i] = rawY;
+            corners_.release(k);
+            continue;
         }
+        CornerMap::Entry &e = corners_.acquire(k);
+        if (e.refs > 1)
+            continue;
+        if (!freeSlots_.empty()) {
+            e.vertex = freeSlots_.back();
+            freeSlots_.pop_back();
+        } else {
+            e.vertex = GLuint(slotKeys_.size());
+            slotKeys_.push_back(CornerMap::EMPTY);
+        }
+        slotKeys_[e.vertex] = k;
+        dirtySlots_.push_back(e.vertex);
+    }
+}
+
+int GravityWell::locate(uint32_t x, uint32_t z, int level) const noexcept {
+    int i = 0;
+    while (nodes_[i].child != -1 && nodes_[i].level < level) {
+        const Node &n = nodes_[i];
+        uint32_t half = span(n) / 2;
+        i = n.child + int(x >= n.x + half) + 2 * int(z >= n.z + half);
+    }
+    return i;
+}
+
+// One point just outside each side is enough: a neighbour no finer than
+// `n` covers the whole side.
+template <class Visit>
+void GravityWell::forNeighbours(const Node &n, int level,
+                                Visit visit) const {
+    uint32_t s = span(n);
+    if (n.x > 0)
+        visit(locate(n.x - 1, n.z, level));
+    if (n.z > 0)
+        visit(locate(n.x, n.z - 1, level));
+    if (n.x + s < EXTENT)
+        visit(locate(n.x + s, n.z, level));
+    if (n.z + s < EXTENT)
+        visit(locate(n.x, n.z + s, level));
+}
+
+void GravityWell::markDirty(int node) {
+    if (nodes_[node].dirty)
+        return;
+    nodes_[node].dirty = true;
+    dirtyNodes_.push_back(uint32_t(node));
+}
+
+int GravityWell::forcedSplits(int node) const noexcept {
+    const Node &n = nodes_[node];
+    int count = 0;
+    forNeighbours(n, n.level, [&](int i) {
+        if (nodes_[i].level < n.level)
+            count += 1 + forcedSplits(i);
+    });
+    return count;
+}
+
+void GravityWell::split(int node) {
+    // Splitting next to a coarser leaf would leave it two levels finer, so
+    // that leaf goes first. Copied: those splits may grow nodes_.
+    Node outer = nodes_[node];
+    forNeighbours(outer, outer.level, [&](int i) {
+        if (nodes_[i].level < outer.level)
+            split(i);
+    });
+
+    int first;
+    if (!freeBlocks_.empty()) {
+        first = freeBlocks_.back();
+        freeBlocks_.pop_back();
+    } else {
+        first = int(nodes_.size());
+        nodes_.resize(nodes_.size() + 4);
+    }
+
+    // Children take their corners before the parent lets go, so shared
+    // corners keep their slots.
+    Node &n = nodes_[node];
+    uint32_t half = span(n) / 2;
+    for (int k = 0; k < 4; ++k) {
+        Node &c = nodes_[first + k];
+        uint32_t stamp = c.stamp + 1; // a reused slot must not match old
+        bool dirty = c.dirty;
+        c = {n.x + (k & 1) * half, n.z + (k >> 1) * half, n.level + 1, node};
+        c.stamp = stamp;
+        c.dirty = dirty;
+        addCorners(c, +1);
+        markDirty(first + k);
+    }
+    addCorners(n, -1);
+    n.child = first;
+    ++n.stamp;
+    markDirty(node);
+    // Same-size neighbours gain a corner on their shared side.
+    forNeighbours(n, n.level, [&](int i) {
+        if (nodes_[i].child == -1)
+            markDirty(i);
+    });
+}
+
+void GravityWell::merge(int node) {
+    Node &n = nodes_[node];
+    addCorners(n, +1);
+    for (int k = 0; k < 4; ++k) {
+        Node &c = nodes_[n.child + k];
+        addCorners(c, -1);
+        c.level = -1; // unused
+        ++c.stamp;
+        markDirty(n.child + k);
+    }
+    freeBlocks_.push_back(n.child);
+    n.child = -1;
+    ++n.stamp;
+    markDirty(node);
+    forNeighbours(n, n.level, [&](int i) {
+        if (nodes_[i].child == -1)
+            markDirty(i);
+    });
+}
+
+bool GravityWell::mergeable(int node) const noexcept {
+    const Node &n = nodes_[node];
+    if (n.child == -1 || n.level < MIN_DEPTH)
+        return false;
+    for (int k = 0; k < 4; ++k)
+        if (nodes_[n.child + k].child != -1)
+            return false;
+    // Balance also rules out a child with a finer neighbour: that
+    // neighbour would end up two levels below the merged node.
+    for (int k = 0; k < 4; ++k) {
+        const Node &c = nodes_[n.child + k];
+        bool finer = false;
+        forNeighbours(c, c.level, [&](int i) {
+            finer |= nodes_[i].child != -1 && nodes_[i].level == c.level;
+        });
+        if (finer)
+            return false;
+    }
+    return true;
+}
+
+void GravityWell::buildSources(const ParticleStore &store) {
+    sources_.clear();
+    size_t n = store.size();
+    if (n <= EXACT_SOURCES) {
+        for (size_t i = 0; i < n; ++i)
+            sources_.emplace_back(float(store.px[i]), 0.0f,
+                                  float(store.pz[i]), float(store.m[i]));
+        return;
     }
 
-    constexpr float K = 0.2f;
-    constexpr float SCALE = 15.0f;
-    auto warp = [&](float v) {
-        float t = (2.0f / 3.14159265f) * std::atan(v * K);
-        return t * SCALE;
+    // Too many bodies to test every patch against: lump them into their
+    // centre of mass per bin. Heights on the GPU still use every body.
+    bins_.assign(SOURCE_BINS * SOURCE_BINS, glm::dvec3{0.0});
+    double toBin = SOURCE_BINS / (2.0 * size_);
+    for (size_t i = 0; i < n; ++i) {
+        int bx = std::clamp(int((store.px[i] + size_) * toBin), 0,
+                            SOURCE_BINS - 1);
+        int bz = std::clamp(int((store.pz[i] + size_) * toBin), 0,
+                            SOURCE_BINS - 1);
+        bins_[bz * SOURCE_BINS + bx] +=
+            glm::dvec3{store.px[i] * store.m[i], store.pz[i] * store.m[i],
+                       store.m[i]};
+    }
+    for (const auto &b : bins_)
+        if (b.z > 0.0)
+            sources_.emplace_back(float(b.x / b.z), 0.0f, float(b.y / b.z),
+                                  float(b.z));
+}
+
+// How far the warped surface bulges from a flat patch over this node: each
+// source contributes the potential difference between the patch centre and
+// its corners, which falls off like h^2 / d^3 far away and stays bounded
+// under the source, scaled by the slope of the warp at the centre.
+float GravityWell::patchError(const Node &n) const noexcept {
+    uint32_t s = span(n);
+    glm::vec2 c = toWorld(n.x + s / 2, n.z + s / 2);
+    float h = size_ * float(s) / EXTENT;
+
+    float potential = 0.0f, bulge = 0.0f;
+    for (const glm::vec4 &src : sources_) {
+        float dx = c.x - src.x, dz = c.y - src.z;
+        float d2 = dx * dx + dz * dz + WELL_SOFTENING;
+        float nearInv = 1.0f / std::sqrt(d2);
+        float farInv = 1.0f / std::sqrt(d2 + 2.0f * h * h);
+        potential -= G_ * src.w * nearInv;
+        bulge += G_ * src.w * (nearInv - farInv);
+    }
+    float kp = K * potential;
+    float slope = (2.0f / PI) * SCALE * K / (1.0f + kp * kp);
+    return slope * bulge;
+}
+
+void GravityWell::refine() {
+    // splits_ is a max-heap, merges_ a min-heap.
+    auto pushSplit = [&](Candidate c) {
+        splits_.push_back(c);
+        std::push_heap(splits_.begin(), splits_.end(), std::less<>{});
     };
+    auto popSplit = [&] {
+        std::pop_heap(splits_.begin(), splits_.end(), std::less<>{});
+        splits_.pop_back();
+    };
+    auto pushMerge = [&](Candidate c) {
+        merges_.push_back(c);
+        std::push_heap(merges_.begin(), merges_.end(), std::greater<>{});
+    };
+    auto popMerge = [&] {
+        std::pop_heap(merges_.begin(), merges_.end(), std::greater<>{});
+        merges_.pop_back();
+    };
+    splits_.clear();
+    merges_.clear();
 
-    float *ptr = cpuBuffer_.data();
-    for (int j = 0; j < N; ++j) {
-        for (int i = 0; i < N - 1; ++i) {
-            float x0 = (i - resolution_) * step;
-            float z0 = (j - resolution_) * step;
-            float y0 = warp(yGrid_[j * N + i]);
-            float x1 = (i + 1 - resolution_) * step;
-            float y1 = warp(yGrid_[j * N + (i + 1)]);
-
-            *ptr++ = x0;
-            *ptr++ = y0;
-            *ptr++ = z0;
-            *ptr++ = x1;
-            *ptr++ = y1;
-            *ptr++ = z0;
-        }
+    auto queueLeaf = [&](int i) {
+        const Node &n = nodes_[i];
+        if (n.level < MAX_DEPTH)
+            pushSplit({n.error, i, n.stamp});
+    };
+    auto pushLeaf = [&](int i) {
+        nodes_[i].error = patchError(nodes_[i]);
+        queueLeaf(i);
+    };
+    // A parent's merge cost is the error its single patch would have.
+    auto pushParent = [&](int i) {
+        if (i >= 0 && mergeable(i))
+            pushMerge({nodes_[i].error, i, nodes_[i].stamp});
+    };
+
+    // Errors are refreshed for one slice of the tree per update; bodies
+    // move little in that many frames.
+    ++frame_;
+    for (int i = 0; i < int(nodes_.size()); ++i) {
+        Node &n = nodes_[i];
+        if (n.level < 0 || (n.child != -1 && !mergeable(i)))
+            continue;
+        if (n.error < 0.0f || uint32_t(i) % REFRESH_SLICES ==
+                                  frame_ % REFRESH_SLICES)
+            n.error = patchError(n);
+        if (n.child == -1)
+            queueLeaf(i);
+        else
+            pushParent(i);
     }
-    for (int i = 0; i < N; ++i) {
-        for (int j = 0; j < N - 1; ++j) {
-            float x0 = (i - resolution_) * step;
-            float z0 = (j - resolution_) * step;
-            float y0 = warp(yGrid_[j * N + i]);
-            float z1 = (j + 1 - resolution_) * step;
-            float y1 = warp(yGrid_[(j + 1) * N + i]);
-
-            *ptr++ = x0;
-            *ptr++ = y0;
-            *ptr++ = z0;
-            *ptr++ = x0;
-            *ptr++ = y1;
-            *ptr++ = z1;
+
+    auto doMerge = [&](int i) {
+        merge(i);
+        pushLeaf(i);
+        pushParent(nodes_[i].parent);
+    };
+    auto doSplit = [&](int i) {
+        split(i);
+        for (int k = 0; k < 4; ++k)
+            pushLeaf(nodes_[i].child + k);
+        pushParent(i);
+    };
+
+    for (int ops = 0; ops < MAX_OPS_PER_UPDATE; ++ops) {
+        while (!splits_.empty() &&
+               (nodes_[splits_.front().node].child != -1 ||
+                nodes_[splits_.front().node].stamp != splits_.front().stamp))
+            popSplit();
+        while (!merges_.empty() &&
+               (!mergeable(merges_.front().node) ||
+                nodes_[merges_.front().node].stamp != merges_.front().stamp))
+            popMerge();
+
+        bool haveMerge = !merges_.empty();
+        if (haveMerge && (merges_.front().error < FLAT_ERROR ||
+                          corners_.size() > vertexBudget_)) {
+            int i = merges_.front().node;
+            popMerge();
+            doMerge(i);
+            continue;
+        }
+        if (splits_.empty() || splits_.front().error < FLAT_ERROR)
+            break;
+
+        // A split adds at most five corners, and so does each split it
+        // forces on a coarser neighbour.
+        int leaf = splits_.front().node;
+        if (corners_.size() + 5 * (1 + size_t(forcedSplits(leaf))) <=
+            vertexBudget_) {
+            popSplit();
+            doSplit(leaf);
+            continue;
         }
+        if (haveMerge &&
+            merges_.front().error < TRADE_RATIO * splits_.front().error &&
+            merges_.front().node != nodes_[leaf].parent) {
+            int i = merges_.front().node;
+            popMerge();
+            doMerge(i);
+            continue;
+        }
+        break;
     }
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_.id);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, cpuBuffer_.size() * sizeof(float),
-                    cpuBuffer_.data());
+// Emits the side from a to b as lines, split wherever a finer neighbour
+// has put a corner on it (at most once, given balance).
+void GravityWell::emitSide(uint32_t ax, uint32_t az, uint32_t bx,
+                           uint32_t bz) {
+    uint32_t length = (bx - ax) + (bz - az);
+    uint32_t mx = (ax + bx) / 2, mz = (az + bz) / 2;
+    if (length >= 2 && corners_.find(key(mx, mz))) {
+        emitSide(ax, az, mx, mz);
+        emitSide(mx, mz, bx, bz);
+        return;
+    }
+    indexStaging_.push_back(corners_.find(key(ax, az))->vertex);
+    indexStaging_.push_back(corners_.find(key(bx, bz))->vertex);
+}
+
+// Each leaf draws its low-x and low-z sides, plus the high ones on the
+// domain border, so each edge is drawn once. Other blocks draw nothing.
+void GravityWell::emitBlock(const Node &n) {
+    size_t end = indexStaging_.size() + BLOCK_INDICES;
+    if (n.level >= 0 && n.child == -1) {
+        uint32_t s = span(n);
+        emitSide(n.x, n.z, n.x, n.z + s);
+        emitSide(n.x, n.z, n.x + s, n.z);
+        if (n.x + s == EXTENT)
+            emitSide(n.x + s, n.z, n.x + s, n.z + s);
+        if (n.z + s == EXTENT)
+            emitSide(n.x, n.z + s, n.x + s, n.z + s);
+    }
+    indexStaging_.resize(end, RESTART);
+}
+
+void GravityWell::uploadTopology() {
+    // Storage is sized from the budget and only grows when the budget
+    // rises or freed slots pile up; a balanced tree has about 4/3 nodes per
+    // corner.
+    size_t bytes = std::max(slotKeys_.size(), vertexBudget_) *
+                   sizeof(glm::vec4);
+    if (bytes > vertexCapacity_) {
+        bytes = std::max(bytes, 2 * vertexCapacity_);
+        grow(vertices_, vertexCapacity_, bytes, 0);
+        vertexCapacity_ = bytes;
+    }
+    size_t blocks = std::max(nodes_.size(), 2 * vertexBudget_);
+    if (blocks > blockCapacity_) {
+        blocks = std::max(blocks, 2 * blockCapacity_);
+        grow(ebo_, blockCapacity_ * BLOCK_INDICES * sizeof(GLuint),
+             blocks * BLOCK_INDICES * sizeof(GLuint), RESTART);
+        blockCapacity_ = blocks;
+        glBindVertexArray(vao_.id);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_.id);
+        glBindVertexArray(0);
+    }
+
+    std::sort(dirtySlots_.begin(), dirtySlots_.end());
+    dirtySlots_.erase(std::unique(dirtySlots_.begin(), dirtySlots_.end()),
+                      dirtySlots_.end());
+    std::sort(dirtyNodes_.begin(), dirtyNodes_.end());
+    indexStaging_.clear();
+    for (uint32_t i : dirtyNodes_) {
+        nodes_[i].dirty = false;
+        emitBlock(nodes_[i]);
+    }
+
+    // The patches go up through the stream ring and are copied into place.
+    // Only x and z matter here; the compute pass fills in y.
+    size_t vertexBytes = dirtySlots_.size() * sizeof(glm::vec4);
+    size_t indexBytes = indexStaging_.size() * sizeof(GLuint);
+    auto *patch =
+        static_cast<std::byte *>(patches_.next(vertexBytes + indexBytes));
+    auto *xz = reinterpret_cast<glm::vec4 *>(patch);
+    for (size_t k = 0; k < dirtySlots_.size(); ++k) {
+        uint64_t c = slotKeys_[dirtySlots_[k]];
+        glm::vec2 p = toWorld(uint32_t(c >> 32), uint32_t(c));
+        xz[k] = glm::vec4(p.x, 0.0f, p.y, 1.0f);
+    }
+    std::memcpy(patch + vertexBytes, indexStaging_.data(), indexBytes);
+
+    BufferRange range = patches_.range();
+    glBindBuffer(GL_COPY_READ_BUFFER, range.buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, vertices_.id);
+    copyRuns(range.offset, dirtySlots_, sizeof(glm::vec4));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, ebo_.id);
+    copyRuns(range.offset + GLintptr(vertexBytes), dirtyNodes_,
+             BLOCK_INDICES * sizeof(GLuint));
+    patches_.fence();
+    indexCount_ = static_cast<GLsizei>(nodes_.size() * BLOCK_INDICES);
+
+    dirtySlots_.clear();
+    dirtyNodes_.clear();
+}
+
+void GravityWell::update(const ParticleStore &store, BufferRange bodies,
+                         float G) {
+    PROFILE_ZONE("GravityWell::update");
+    G_ = G;
+    buildSources(store);
+    refine();
+    if (!dirtySlots_.empty() || !dirtyNodes_.empty())
+        uploadTopology();
+    if (potentialGrid_) {
+        dispatchGrid(store, G);
+        return;
+    }
+
+    shader_.bind();
+    glUniform1ui(locBodies_, GLuint(store.size()));
+    glUniform1ui(locVertices_, GLuint(slotKeys_.size()));
+    glUniform1f(locG_, G);
+    bodies.bind(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, vertices_.id);
+    shader_.dispatch(static_cast<int>(slotKeys_.size()));
+}
+
+void GravityWell::dispatchGrid(const ParticleStore &store, float G) {
+    mesh_.solvePlane(store, WELL_SOFTENING, glm::dvec2(0.0), size_);
+    std::span<const double> phi = mesh_.potential();
+    std::span<float> grid = grid_.next<float>(phi.size());
+    std::copy(phi.begin(), phi.end(), grid.begin());
+
+    if (!gridShader_) {
+        gridShader_ = std::make_unique<ComputeShader>(
+            "shaders/gravitywell.comp",
+            std::vector<std::pair<std::string, int>>{{"POTENTIAL_GRID", 1}});
+        GLuint prog = gridShader_->id();
+        locGridVertices_ = glGetUniformLocation(prog, "u_Vertices");
+        locGridG_ = glGetUniformLocation(prog, "u_G");
+        locGridSize_ = glGetUniformLocation(prog, "u_GridSize");
+        locGridOrigin_ = glGetUniformLocation(prog, "u_GridOrigin");
+        locGridCell_ = glGetUniformLocation(prog, "u_GridCell");
+    }
+    gridShader_->bind();
+    glm::dvec3 origin = mesh_.origin();
+    glUniform1ui(locGridVertices_, GLuint(slotKeys_.size()));
+    glUniform1f(locGridG_, G);
+    glUniform1i(locGridSize_, GRID_SIZE);
+    glUniform2f(locGridOrigin_, float(origin.x), float(origin.z));
+    glUniform1f(locGridCell_, float(mesh_.cellSize()));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, vertices_.id);
+    grid_.range().bind(GL_SHADER_STORAGE_BUFFER, 10);
+    gridShader_->dispatch(static_cast<int>(slotKeys_.size()));
+    grid_.fence();
+}
+
+void GravityWell::updateFromBodies(const ParticleStore &store, float G) {
+    PROFILE_ZONE("GravityWell::updateFromBodies");
+    if (potentialGrid_) { // heights come from the store, not an SSBO
+        update(store, {}, G);
+        return;
+    }
+    size_t n = store.size();
+    std::span<glm::vec4> bodies = bodies_.next<glm::vec4>(n);
+    for (size_t i = 0; i < n; ++i)
+        bodies[i] = glm::vec4(float(store.px[i]), float(store.py[i]),
+                              float(store.pz[i]), float(store.m[i]));
+    update(store, bodies_.range(), G);
+    bodies_.fence();
 }
 
 void GravityWell::draw() const noexcept {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, vertices_.id);
     glBindVertexArray(vao_.id);
-    glDrawArrays(GL_LINES, 0, static_cast<GLsizei>(vertexCount_));
+    glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+    glDrawElements(GL_LINES, indexCount_, GL_UNSIGNED_INT, nullptr);
+    glDisable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
 }
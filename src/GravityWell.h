@@ -1,30 +1,176 @@
 #pragma once
 
+#include "ComputeShader.h"
+#include "ParticleMesh.h"
+#include "ParticleStore.h"
+#include "StreamBuffer.h"
 #include "raii.h"
+#include <cstdint>
 #include <glm/glm.hpp>
+#include <memory>
 #include <vector>
 
-class CelestialBody;
-
+// Warped potential surface under the bodies, drawn as an adaptive quadtree
+// wireframe. Each frame the tree is refined where a bilinear patch would
+// misrepresent the warped surface most (near bodies and across steep
+// gradients) and coarsened where it is flat, a bounded number of
+// splits/merges at a time and within a vertex budget. The tree is kept 2:1
+// balanced, so a leaf side meets at most two finer neighbours and each leaf
+// draws at most BLOCK_INDICES indices. Corners keep their vertex slot and
+// leaves their index block, so only what a split or merge changed is
+// uploaded. A compute shader then evaluates the heights of the current
+// vertices straight from a body SSBO, or in grid mode by sampling a
+// particle-mesh potential, which trades the per-vertex sum over bodies for
+// one O(N + M log M) solve.
 class GravityWell {
   public:
-    GravityWell(float size, int resolution);
+    // The surface covers [-size, size] in x and z.
+    GravityWell(float size, size_t vertexBudget);
     ~GravityWell() noexcept;
 
-    void updateFromBodies(const std::vector<CelestialBody *> &bodies,
-                          float G) noexcept;
+    // `bodies` holds the bodies of `store` as vec4s laid out like
+    // gravity.comp's BodyData; `store` itself drives refinement.
+    void update(const ParticleStore &store, BufferRange bodies, float G);
+    // Uploads `store` first, for callers without a body SSBO.
+    void updateFromBodies(const ParticleStore &store, float G);
     void draw() const noexcept;
 
+    void setVertexBudget(size_t budget) noexcept { vertexBudget_ = budget; }
+    size_t getVertexBudget() const noexcept { return vertexBudget_; }
+    size_t vertexCount() const noexcept { return corners_.size(); }
+
+    void setPotentialGrid(bool on) noexcept { potentialGrid_ = on; }
+    bool getPotentialGrid() const noexcept { return potentialGrid_; }
+
   private:
+    static constexpr int MIN_DEPTH = 4; // keeps a 16 x 16 background grid
+    static constexpr int MAX_DEPTH = 12;
+    static constexpr uint32_t EXTENT = 1u << MAX_DEPTH; // finest units
+    static constexpr int MAX_OPS_PER_UPDATE = 256;
+    static constexpr uint32_t REFRESH_SLICES = 4;
+    // Height error below which a patch is considered flat.
+    static constexpr float FLAT_ERROR = 0.004f;
+    // Above this many bodies refinement uses a mass-binned stand-in.
+    static constexpr size_t EXACT_SOURCES = 256;
+    static constexpr int SOURCE_BINS = 16;
+    static constexpr int GRID_SIZE = 256;
+    // Four sides of at most two lines each under 2:1 balance; unused
+    // entries hold the primitive restart index.
+    static constexpr size_t BLOCK_INDICES = 16;
+    static constexpr GLuint RESTART = ~GLuint(0);
+
+    struct Node {
+        uint32_t x, z; // min corner, finest units
+        int level;
+        int parent;
+        int child = -1; // first of four consecutive children, -1 for leaves
+        float error = -1.0f; // cached patchError, -1 until computed
+        uint32_t stamp = 0; // bumped on every split/merge to expire queues
+        bool dirty = false; // index block awaits upload
+    };
+
+    struct Candidate {
+        float error;
+        int node;
+        uint32_t stamp;
+        bool operator<(const Candidate &o) const { return error < o.error; }
+        bool operator>(const Candidate &o) const { return error > o.error; }
+    };
+
+    // Open-addressed map from packed corner coordinates to the number of
+    // leaves sharing the corner and its vertex slot. Erased slots are kept,
+    // so once grown it stops allocating as the tree changes.
+    class CornerMap {
+      public:
+        static constexpr uint64_t EMPTY = ~uint64_t(0);
+        struct Entry {
+            uint64_t key = EMPTY;
+            uint32_t refs = 0;
+            GLuint vertex = 0;
+        };
+
+        // The entry is new if its refs are 1 afterwards.
+        Entry &acquire(uint64_t k);
+        void release(uint64_t k) noexcept; // k must be present
+        const Entry *find(uint64_t k) const noexcept;
+        size_t size() const noexcept { return size_; }
+
+      private:
+        std::vector<Entry> slots_; // power-of-two size
+        size_t size_ = 0;
+
+        size_t home(uint64_t k) const noexcept;
+        // Slot holding k, or the unused slot where it would go.
+        size_t probe(uint64_t k) const noexcept;
+        void grow();
+    };
+
+    ComputeShader shader_;
+    GLint locBodies_ = -1, locVertices_ = -1, locG_ = -1;
+    std::unique_ptr<ComputeShader> gridShader_; // built on first grid update
+    GLint locGridVertices_ = -1, locGridG_ = -1, locGridSize_ = -1;
+    GLint locGridOrigin_ = -1, locGridCell_ = -1;
     VertexArray vao_;
-    Buffer vbo_;
-    size_t vertexCount_;
+    Buffer ebo_, vertices_;
+    StreamBuffer bodies_, grid_;
+    StreamBuffer patches_; // changed slots, then changed index blocks
+    GLsizei indexCount_ = 0;
+    size_t vertexCapacity_ = 0, blockCapacity_ = 0;
 
     float size_;
-    int resolution_;
+    float G_ = 0.5f;
+    size_t vertexBudget_;
+    bool potentialGrid_ = false;
+    uint32_t frame_ = 0;
+
+    std::vector<Node> nodes_;
+    std::vector<int> freeBlocks_; // first index of unused groups of four
+    // Corners of all leaves, keyed by packed finest coordinates.
+    CornerMap corners_;
+    std::vector<glm::vec4> sources_; // xz position, w mass
+    std::vector<glm::dvec3> bins_;   // mass-weighted x, z and mass
+    // refine()'s heaps, kept to reuse their storage.
+    std::vector<Candidate> splits_, merges_;
+
+    // Vertex slots, each holding one corner while it exists; freed slots
+    // are reused. The compute pass covers every slot ever used.
+    std::vector<uint64_t> slotKeys_;
+    std::vector<GLuint> freeSlots_;
+    // Slots and index blocks (one per node) changed since the last upload.
+    std::vector<GLuint> dirtySlots_;
+    std::vector<uint32_t> dirtyNodes_;
+    std::vector<GLuint> indexStaging_;
+
+    ParticleMesh mesh_{GRID_SIZE};
 
-    std::vector<float> cpuBuffer_;
-    std::vector<float> yGrid_;
+    void buildSources(const ParticleStore &store);
+    float patchError(const Node &n) const noexcept;
+    void refine();
+    // Splits coarser neighbours first to keep the tree balanced.
+    void split(int node);
+    void merge(int node);
+    bool mergeable(int node) const noexcept;
+    // Splits that split(node) would force on coarser neighbours, counting
+    // some twice.
+    int forcedSplits(int node) const noexcept;
+    // The deepest node no deeper than `level` containing finest point x, z.
+    int locate(uint32_t x, uint32_t z, int level) const noexcept;
+    // Calls visit with the node just across each side of `n` that is at
+    // most `level` deep.
+    template <class Visit>
+    void forNeighbours(const Node &n, int level, Visit visit) const;
+    void markDirty(int node);
+    void addCorners(const Node &n, int delta);
+    void uploadTopology();
+    void emitBlock(const Node &n);
+    void emitSide(uint32_t ax, uint32_t az, uint32_t bx, uint32_t bz);
+    void dispatchGrid(const ParticleStore &store, float G);
 
-    void setupBuffers() noexcept;
+    glm::vec2 toWorld(uint32_t x, uint32_t z) const noexcept;
+    static uint64_t key(uint32_t x, uint32_t z) noexcept {
+        return (uint64_t(x) << 32) | z;
+    }
+    static uint32_t span(const Node &n) noexcept {
+        return EXTENT >> n.level;
+    }
 };
@@ -0,0 +1,371 @@
+#include "Headless.h"
+#include "AllocationCounter.h"
+#include "Checkpoint.h"
+#include "EglContext.h"
+#include "Scenarios.h"
+#include "Trajectory.h"
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// Energy is O(N²) on the CPU, so skip it where it would dominate the run.
+constexpr int MAX_ENERGY_BODIES = 20000;
+// Steps allowed to size scratch buffers before --check-allocations counts.
+constexpr uint64_t WARMUP_STEPS = 16;
+
+const char *USAGE =
+    "usage: spacetime --headless [options]\n"
+    "  --bodies N        3 = figure-eight, otherwise a random cube (3)\n"
+    "  --steps N         physics steps to run (1000)\n"
+    "  --dt X            step size (0.01)\n"
+    "  --backend B       cpu | bh | pm | gpu | gpu-resident (cpu)\n"
+    "  --integrator I    leapfrog | pefrl | yoshida4 | yoshida6 | yoshida8\n"
+    "  --block           hierarchical block timesteps\n"
+    "  --theta X         Barnes-Hut opening angle (0.5)\n"
+    "  --grid N          particle-mesh grid size (32)\n"
+    "  --cic             particle-mesh cloud-in-cell instead of TSC\n"
+    "  --p3m             particle-mesh short-range pair correction\n"
+    "  --seed N          random cube seed (1)\n"
+    "  --load PATH       continue a checkpoint with its settings; the\n"
+    "                    options for those settings override them\n"
+    "  --save PATH       write a checkpoint after the last step\n"
+    "  --record PATH     write a compressed trajectory file\n"
+    "  --record-every N  steps between trajectory frames (10)\n"
+    "  --check-allocations  fail if steps allocate after a short warm-up\n";
+
+struct BackendName {
+    const char *key;
+    ForceBackend backend;
+    bool resident;
+};
+constexpr BackendName BACKENDS[] = {
+    {"cpu", ForceBackend::CpuDirect, false},
+    {"bh", ForceBackend::BarnesHut, false},
+    {"pm", ForceBackend::ParticleMesh, false},
+    {"gpu", ForceBackend::GpuDirect, false},
+    {"gpu-resident", ForceBackend::GpuDirect, true},
+};
+
+const char *backendLabel(const Headless::Options &o) {
+    switch (o.backend) {
+    case ForceBackend::CpuDirect:
+        return "CPU direct sum";
+    case ForceBackend::BarnesHut:
+        return "Barnes-Hut";
+    case ForceBackend::ParticleMesh:
+        return o.p3m ? "particle mesh (P3M)" : "particle mesh";
+    case ForceBackend::GpuDirect:
+        return o.gpuResident ? "GPU direct sum (resident)" : "GPU direct sum";
+    }
+    return "?";
+}
+// Settings from the command line override the checkpoint's; the others are
+// taken from it so the run and its report use them.
+template <class T, class U> void pick(bool given, T &option, U &setting) {
+    if (given)
+        setting = option;
+    else
+        option = setting;
+}
+
+void resolve(Headless::Options &o, Checkpoint::Settings &s) {
+    using O = Headless::Options;
+    pick(o.given & O::Dt, o.dt, s.dt);
+    pick(o.given & O::Backend, o.backend, s.backend);
+    pick(o.given & O::Backend, o.gpuResident, s.gpuResident);
+    pick(o.given & O::Scheme, o.integrator, s.integrator);
+    pick(o.given & O::Block, o.blockTimesteps, s.blockTimesteps);
+    pick(o.given & O::Theta, o.theta, s.theta);
+    pick(o.given & O::Grid, o.grid, s.meshGrid);
+    pick(o.given & O::Assignment, o.assignment, s.assignment);
+    pick(o.given & O::P3m, o.p3m, s.meshShortRange);
+}
+} // namespace
+
+namespace Headless {
+std::optional<Options> parseArgs(int argc, char **argv) {
+    bool headless = false;
+    Options o;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc)
+                throw std::invalid_argument(std::string(arg) +
+                                            " needs a value\n" + USAGE);
+            return argv[++i];
+        };
+
+        if (arg == "--headless")
+            headless = true;
+        else if (arg == "--bodies")
+            o.bodies = std::stoi(value());
+        else if (arg == "--steps")
+            o.steps = std::stoull(value());
+        else if (arg == "--dt") {
+            o.dt = std::stod(value());
+            o.given |= Options::Dt;
+        } else if (arg == "--theta") {
+            o.theta = std::stod(value());
+            o.given |= Options::Theta;
+        } else if (arg == "--seed")
+            o.seed = static_cast<unsigned>(std::stoul(value()));
+        else if (arg == "--grid") {
+            o.grid = std::stoi(value());
+            o.given |= Options::Grid;
+        } else if (arg == "--cic") {
+            o.assignment = MassAssignment::CIC;
+            o.given |= Options::Assignment;
+        } else if (arg == "--p3m") {
+            o.p3m = true;
+            o.given |= Options::P3m;
+        } else if (arg == "--block") {
+            o.blockTimesteps = true;
+            o.given |= Options::Block;
+        } else if (arg == "--load")
+            o.load = value();
+        else if (arg == "--save")
+            o.save = value();
+        else if (arg == "--record")
+            o.record = value();
+        else if (arg == "--record-every")
+            o.recordEvery = std::stoull(value());
+        else if (arg == "--check-allocations")
+            o.checkAllocations = true;
+        else if (arg == "--backend") {
+            std::string key = value();
+            bool found = false;
+            for (const auto &b : BACKENDS)
+                if (key == b.key) {
+                    o.backend = b.backend;
+                    o.gpuResident = b.resident;
+                    o.given |= Options::Backend;
+                    found = true;
+                }
+            if (!found)
+                throw std::invalid_argument("unknown backend '" + key +
+                                            "'\n" + USAGE);
+        } else if (arg == "--integrator") {
+            std::string key = value();
+            bool found = false;
+            for (size_t k = 0; k < Integrators::TABLE.size(); ++k)
+                if (key == Integrators::TABLE[k].key) {
+                    o.integrator = static_cast<Integrator>(k);
+                    o.given |= Options::Scheme;
+                    found = true;
+                }
+            if (!found)
+                throw std::invalid_argument("unknown integrator '" + key +
+                                            "'\n" + USAGE);
+        } else if (arg == "--help" || arg == "-h") {
+            std::fputs(USAGE, stdout);
+            std::exit(0);
+        } else
+            throw std::invalid_argument("unknown option '" +
+                                        std::string(arg) + "'\n" + USAGE);
+    }
+
+    if (!headless)
+        return std::nullopt;
+    if (o.bodies < 1 || o.dt <= 0.0)
+        throw std::invalid_argument("--bodies and --dt must be positive");
+    if (o.checkAllocations && !AllocationCounter::enabled())
+        throw std::invalid_argument("--check-allocations needs a build with "
+                                    "SPACETIME_COUNT_ALLOCATIONS");
+    if (o.recordEvery == 0)
+        throw std::invalid_argument("--record-every must be positive");
+    // The recorder's index grows with every frame it writes.
+    if (o.checkAllocations && !o.record.empty())
+        throw std::invalid_argument("--check-allocations can't be combined "
+                                    "with --record");
+    if (o.checkAllocations && o.steps <= WARMUP_STEPS)
+        throw std::invalid_argument("--check-allocations needs more than " +
+                                    std::to_string(WARMUP_STEPS) + " steps");
+    return o;
+}
+
+int run(const Options &opts) {
+    // A checkpoint decides the settings, so it is read before anything
+    // depends on them.
+    Options o = opts;
+    Checkpoint::Settings start;
+    ParticleStore loaded;
+    double loadMs = 0.0;
+    if (!o.load.empty()) {
+        auto begin = Clock::now();
+        start = Checkpoint::load(o.load, loaded);
+        loadMs = std::chrono::duration<double, std::milli>(Clock::now() -
+                                                           begin)
+                     .count();
+        resolve(o, start);
+    }
+
+    // GPU backends need a current context before the engine touches GL.
+    std::unique_ptr<EglContext> gl;
+    if (o.backend == ForceBackend::GpuDirect) {
+        gl = std::make_unique<EglContext>();
+        std::printf("renderer      %s\n",
+                    reinterpret_cast<const char *>(glGetString(GL_RENDERER)));
+    }
+
+    PhysicsEngine engine(o.backend);
+    if (o.load.empty()) {
+        engine.setGpuResident(o.gpuResident);
+        engine.setIntegrator(o.integrator);
+        engine.setBlockTimesteps(o.blockTimesteps);
+        engine.getBarnesHut().setTheta(o.theta);
+        engine.getParticleMesh().setGridSize(o.grid);
+        engine.getParticleMesh().setAssignment(o.assignment);
+        engine.getParticleMesh().setShortRange(o.p3m);
+
+        auto bodies = o.bodies == 3 ? Scenarios::figureEight()
+                                    : Scenarios::randomCube(o.bodies, 100.0,
+                                                            50.0, o.seed);
+        for (const auto &b : bodies)
+            engine.addBody(b.mass, b.position, b.velocity);
+    } else {
+        Checkpoint::apply(start, engine);
+        engine.restore(std::move(loaded));
+        std::printf("checkpoint    %s, t = %g after %llu steps (%.1f ms)\n",
+                    o.load.c_str(), start.time,
+                    static_cast<unsigned long long>(start.steps), loadMs);
+    }
+    size_t n = engine.bodyCount();
+
+    std::printf("bodies        %zu\n", n);
+    std::printf("backend       %s\n", backendLabel(o));
+    if (o.backend == ForceBackend::CpuDirect)
+        std::printf("kernel        %s\n", DirectSum::isaName());
+    if (o.backend == ForceBackend::ParticleMesh)
+        std::printf("grid          %d^3 %s\n",
+                    engine.getParticleMesh().getGridSize(),
+                    o.assignment == MassAssignment::CIC ? "CIC" : "TSC");
+    std::printf("integrator    %s%s\n", Integrators::info(o.integrator).name,
+                o.blockTimesteps ? " (block timesteps)" : "");
+    std::printf("steps         %llu x %g\n",
+                static_cast<unsigned long long>(o.steps), o.dt);
+
+    if (gl)
+        engine.prepareGpu();
+
+    std::unique_ptr<Trajectory::Recorder> recorder;
+    if (!o.record.empty()) {
+        recorder = std::make_unique<Trajectory::Recorder>(
+            o.record, Trajectory::Options{.every = o.recordEvery});
+        if (recorder->due(start.steps))
+            recorder->capture(engine.getStore(), start.time, start.steps);
+    }
+    double captureSeconds = 0.0;
+
+    bool energy = n <= MAX_ENERGY_BODIES;
+    double e0 = energy ? engine.totalEnergy() : 0.0;
+
+    auto begin = Clock::now();
+    auto lastReport = begin;
+    uint64_t allocationsBefore = 0;
+    for (uint64_t s = 0; s < o.steps; ++s) {
+        if (s == WARMUP_STEPS)
+            allocationsBefore = AllocationCounter::total();
+        engine.step(o.dt);
+
+        uint64_t step = start.steps + s + 1;
+        if (recorder && recorder->due(step)) {
+            auto captureBegin = Clock::now();
+            engine.syncToHost();
+            recorder->capture(engine.getStore(),
+                              start.time + double(s + 1) * o.dt, step);
+            captureSeconds += std::chrono::duration<double>(Clock::now() -
+                                                            captureBegin)
+                                  .count();
+        }
+
+        auto now = Clock::now();
+        if (now - lastReport > std::chrono::seconds(5)) {
+            std::fprintf(stderr, "  step %llu / %llu\n",
+                         static_cast<unsigned long long>(s + 1),
+                         static_cast<unsigned long long>(o.steps));
+            lastReport = now;
+        }
+    }
+    uint64_t allocations = AllocationCounter::total() - allocationsBefore;
+    engine.syncToHost();
+    if (gl)
+        glFinish();
+    double seconds =
+        std::chrono::duration<double>(Clock::now() - begin).count();
+
+    // Tree, mesh and block steps do less work; this counts what a direct
+    // sum would have needed for the same force evaluations.
+    double interactions =
+        double(engine.forceEvaluations()) * double(n > 1 ? n - 1 : 0);
+
+    std::printf("wall time     %.3f s\n", seconds);
+    std::printf("steps/s       %.4g\n", double(o.steps) / seconds);
+    std::printf("interactions/s %.4g\n", interactions / seconds);
+    if (energy) {
+        double e1 = engine.totalEnergy();
+        std::printf("energy drift  %.3e\n",
+                    e0 != 0.0 ? (e1 - e0) / std::abs(e0) : e1 - e0);
+    }
+    if (recorder) {
+        recorder->close();
+        Trajectory::Recorder::Stats t = recorder->stats();
+        std::printf("trajectory    %s, %llu frames, %.2f MB "
+                    "(%.2f B/body/frame)\n",
+                    o.record.c_str(),
+                    static_cast<unsigned long long>(t.written),
+                    double(t.bytes) / 1e6,
+                    t.written > 0 && n > 0
+                        ? double(t.bytes) / double(t.written * n)
+                        : 0.0);
+        std::printf("capture       %.3f ms/frame, %.2f%% of wall time\n",
+                    t.captured > 0 ? 1e3 * captureSeconds / t.captured : 0.0,
+                    100.0 * captureSeconds / seconds);
+        if (t.dropped > 0)
+            std::printf("dropped       %llu frames\n",
+                        static_cast<unsigned long long>(t.dropped));
+        if (t.failed) {
+            std::fprintf(stderr, "error: cannot write %s\n",
+                         o.record.c_str());
+            return 1;
+        }
+    }
+    if (!o.save.empty()) {
+        auto saveBegin = Clock::now();
+        auto image = Checkpoint::encode(
+            engine.getStore(),
+            Checkpoint::capture(engine, start.time + double(o.steps) * o.dt,
+                                start.steps + o.steps, o.dt));
+        Checkpoint::write(o.save, image);
+        std::printf("saved         %s, %.2f MB (%.1f ms)\n", o.save.c_str(),
+                    double(image.size()) / 1e6,
+                    std::chrono::duration<double, std::milli>(Clock::now() -
+                                                              saveBegin)
+                        .count());
+    }
+    if (o.checkAllocations) {
+        uint64_t counted = o.steps - WARMUP_STEPS;
+        std::printf("allocations   %llu in %llu steps\n",
+                    static_cast<unsigned long long>(allocations),
+                    static_cast<unsigned long long>(counted));
+        if (allocations != 0) {
+            std::fprintf(stderr, "error: steady-state steps allocated "
+                                 "(%.3g per step)\n",
+                         double(allocations) / double(counted));
+            return 1;
+        }
+    }
+    return 0;
+}
+} // namespace Headless
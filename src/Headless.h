@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Integrators.h"
+#include "PhysicsEngine.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// Windowless batch driver: builds a scene, runs a fixed number of physics
+// steps as fast as possible and reports throughput. GPU backends run on a
+// surfaceless EGL context.
+namespace Headless {
+struct Options {
+    int bodies = 3; // 3 is the figure-eight, anything else a random cube
+    uint64_t steps = 1000;
+    double dt = 0.01;
+    ForceBackend backend = ForceBackend::CpuDirect;
+    bool gpuResident = false;
+    Integrator integrator = Integrator::Yoshida4;
+    bool blockTimesteps = false;
+    double theta = 0.5;
+    int grid = 32;
+    MassAssignment assignment = MassAssignment::TSC;
+    bool p3m = false;
+    unsigned seed = 1;
+    // Fail the run if steps after the warm-up allocate from the heap.
+    bool checkAllocations = false;
+    // Continue from a checkpoint instead of building a scene. Settings not
+    // given on the command line come from the checkpoint, dt included.
+    std::string load;
+    enum Setting : uint32_t {
+        Dt = 1,
+        Backend = 2, // and gpuResident
+        Scheme = 4, // integrator
+        Block = 8,
+        Theta = 16,
+        Grid = 32,
+        Assignment = 64,
+        P3m = 128,
+    };
+    uint32_t given = 0; // Setting bits
+    // Write a checkpoint after the last step.
+    std::string save;
+    // Record a trajectory every recordEvery steps.
+    std::string record;
+    uint64_t recordEvery = 10;
+};
+
+// Returns nullopt unless argv contains --headless; throws
+// std::invalid_argument on malformed options.
+std::optional<Options> parseArgs(int argc, char **argv);
+// Returns the process exit code: 1 if checkAllocations found any.
+int run(const Options &opts);
+} // namespace Headless
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <span>
+#include <utility>
+
+enum class Integrator { Leapfrog, ForestRuth, Yoshida4, Yoshida6, Yoshida8 };
+
+namespace Integrators {
+
+// Coefficients of a symplectic drift/kick splitting
+//   D(drift[0]) K(kick[0]) D(drift[1]) ... K(kick[S-1]) D(drift[S])
+// with one force evaluation before every kick.
+template <size_t S> struct Scheme {
+    std::array<double, S + 1> drift;
+    std::array<double, S> kick;
+};
+
+// Chains drift-kick-drift leapfrogs of length w[i] * dt, fusing the two half
+// drifts between neighbours into one.
+template <size_t S>
+constexpr Scheme<S> compose(const std::array<double, S> &w) {
+    Scheme<S> s{};
+    s.drift[0] = 0.5 * w[0];
+    for (size_t i = 0; i < S; ++i) {
+        s.kick[i] = w[i];
+        s.drift[i + 1] = 0.5 * (w[i] + (i + 1 < S ? w[i + 1] : 0.0));
+    }
+    return s;
+}
+
+// Yoshida's symmetric weights w_k .. w_1 w_0 w_1 .. w_k from the outer ones,
+// with the centre chosen so the weights sum to one.
+template <size_t K>
+constexpr std::array<double, 2 * K + 1>
+symmetricWeights(const std::array<double, K> &outer) {
+    std::array<double, 2 * K + 1> w{};
+    double sum = 0.0;
+    for (size_t i = 0; i < K; ++i) {
+        w[i] = w[2 * K - i] = outer[i];
+        sum += outer[i];
+    }
+    w[K] = 1.0 - 2.0 * sum;
+    return w;
+}
+
+inline constexpr Scheme<1> LEAPFROG = compose(std::array{1.0});
+
+// Omelyan, Mryglod & Folk's position-extended Forest–Ruth-like scheme: four
+// force evaluations like Yoshida 4 but a much smaller error constant.
+inline constexpr double PEFRL_XI = 0.1786178958448091;
+inline constexpr double PEFRL_LAMBDA = -0.2123418310626054;
+inline constexpr double PEFRL_CHI = -0.06626458266981849;
+inline constexpr Scheme<4> FOREST_RUTH{
+    {PEFRL_XI, PEFRL_CHI, 1.0 - 2.0 * (PEFRL_CHI + PEFRL_XI), PEFRL_CHI,
+     PEFRL_XI},
+    {0.5 * (1.0 - 2.0 * PEFRL_LAMBDA), PEFRL_LAMBDA, PEFRL_LAMBDA,
+     0.5 * (1.0 - 2.0 * PEFRL_LAMBDA)}};
+
+// 1 / (2 - cbrt(2)), the Suzuki–Yoshida triple jump.
+inline constexpr auto YOSHIDA4 =
+    compose(symmetricWeights(std::array{1.3512071919596578}));
+
+// Yoshida (1990), solution A for 6th and solution D for 8th order.
+inline constexpr auto YOSHIDA6 = compose(symmetricWeights(
+    std::array{0.784513610477560, 0.235573213359357, -1.17767998417887}));
+inline constexpr auto YOSHIDA8 = compose(symmetricWeights(std::array{
+    0.914844246229740, 0.253693336566229, -1.44485223686048,
+    -0.158240635368243, 1.93813913762276, -1.96061023297549,
+    0.102799849391985}));
+
+// Runs one step of S with every stage unrolled at compile time. drift(h),
+// kick(h) and force() act on whatever state the caller closes over.
+template <const auto &S, class Drift, class Kick, class Force>
+inline void step(double dt, Drift &&drift, Kick &&kick, Force &&force) {
+    [&]<size_t... I>(std::index_sequence<I...>) {
+        (
+            [&] {
+                if constexpr (S.drift[I] != 0.0)
+                    drift(S.drift[I] * dt);
+                force();
+                kick(S.kick[I] * dt);
+            }(),
+            ...);
+    }(std::make_index_sequence<S.kick.size()>{});
+    if constexpr (S.drift.back() != 0.0)
+        drift(S.drift.back() * dt);
+}
+
+struct Info {
+    const char *name;
+    const char *key; // command-line / report identifier
+    int order;
+    std::span<const double> drift;
+    std::span<const double> kick;
+    // Whether kick[] are the weights of a leapfrog composition, which the
+    // block timestep scheme can reuse.
+    bool composition;
+};
+
+inline constexpr std::array<Info, 5> TABLE{{
+    {"Leapfrog", "leapfrog", 2, LEAPFROG.drift, LEAPFROG.kick, true},
+    {"Forest-Ruth (PEFRL)", "pefrl", 4, FOREST_RUTH.drift, FOREST_RUTH.kick,
+     false},
+    {"Yoshida 4", "yoshida4", 4, YOSHIDA4.drift, YOSHIDA4.kick, true},
+    {"Yoshida 6", "yoshida6", 6, YOSHIDA6.drift, YOSHIDA6.kick, true},
+    {"Yoshida 8", "yoshida8", 8, YOSHIDA8.drift, YOSHIDA8.kick, true},
+}};
+
+constexpr const Info &info(Integrator integrator) noexcept {
+    return TABLE[static_cast<size_t>(integrator)];
+}
+
+} // namespace Integrators
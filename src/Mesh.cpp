@@ -0,0 +1,63 @@
+#include "Mesh.h"
+
+#include <cmath>
+#include <numbers>
+#include <vector>
+
+Mesh Mesh::uvSphere(int sectorCount, int stackCount) {
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    constexpr float radius = 1.0f;
+
+    for (int i = 0; i <= stackCount; ++i) {
+        float stackAng = std::numbers::pi_v<float> / 2 -
+                         i * std::numbers::pi_v<float> / stackCount;
+        float xy = radius * std::cos(stackAng);
+        float z = radius * std::sin(stackAng);
+        for (int j = 0; j <= sectorCount; ++j) {
+            float sectorAng = j * 2 * std::numbers::pi_v<float> / sectorCount;
+            float x = xy * std::cos(sectorAng);
+            float y = xy * std::sin(sectorAng);
+            float u = float(j) / sectorCount;
+            float v = float(i) / stackCount;
+            vertices.insert(vertices.end(), {x, y, z, u, v});
+        }
+    }
+
+    for (int i = 0; i < stackCount; ++i) {
+        int k1 = i * (sectorCount + 1);
+        int k2 = k1 + sectorCount + 1;
+        for (int j = 0; j < sectorCount; ++j, ++k1, ++k2) {
+            if (i != 0) {
+                indices.push_back(k1);
+                indices.push_back(k2);
+                indices.push_back(k1 + 1);
+            }
+            if (i != stackCount - 1) {
+                indices.push_back(k1 + 1);
+                indices.push_back(k2);
+                indices.push_back(k2 + 1);
+            }
+        }
+    }
+
+    Mesh mesh;
+    mesh.indexCount = static_cast<GLsizei>(indices.size());
+
+    glBindVertexArray(mesh.vao.id);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo.id);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float),
+                 vertices.data(), GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo.id);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
+                 indices.data(), GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), nullptr);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float),
+                          (void *)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glBindVertexArray(0);
+    return mesh;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "raii.h"
+
+// Indexed triangle mesh with position (location 0) and texcoord
+// (location 1) attributes.
+struct Mesh {
+    VertexArray vao;
+    Buffer vbo, ebo;
+    GLsizei indexCount = 0;
+
+    static Mesh uvSphere(int sectorCount = 36, int stackCount = 18);
+
+    void bind() const noexcept { glBindVertexArray(vao.id); }
+    void draw() const noexcept {
+        glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, nullptr);
+    }
+    void drawInstanced(GLsizei instances) const noexcept {
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT,
+                                nullptr, instances);
+    }
+};
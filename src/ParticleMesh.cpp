@@ -0,0 +1,382 @@
+#include "ParticleMesh.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <numbers>
+
+namespace {
+// Cell sizes are rounded up to steps of 2^(1/8) so the Green's function
+// only has to be rebuilt when the bodies' extent changes noticeably.
+constexpr double CELL_STEPS = 8.0;
+
+struct Window {
+    int first;
+    int count;
+    double w[3];
+};
+
+// Assignment weights of a body at grid coordinate u. The same window
+// deposits mass and interpolates the field, so there is no self-force.
+Window window(double u, MassAssignment a) noexcept {
+    if (a == MassAssignment::CIC) {
+        double i = std::floor(u);
+        double f = u - i;
+        return {int(i), 2, {1.0 - f, f, 0.0}};
+    }
+    double i = std::floor(u + 0.5);
+    double d = u - i;
+    return {int(i) - 1,
+            3,
+            {0.5 * (0.5 - d) * (0.5 - d), 0.75 - d * d,
+             0.5 * (0.5 + d) * (0.5 + d)}};
+}
+
+constexpr Window FLAT{0, 1, {1.0, 0.0, 0.0}};
+
+// Potential of a unit mass at distance r: softened Newtonian for the plain
+// mesh, its erf-smoothed long-range part when pairs are corrected.
+double green(double r, double softening, double split) noexcept {
+    if (split > 0.0) {
+        if (r < 1e-6 * split)
+            return -std::numbers::inv_sqrtpi / split;
+        return -std::erf(r / (2.0 * split)) / r;
+    }
+    return -1.0 / std::sqrt(r * r + softening);
+}
+
+// In-place radix-2 transforms of `batch` interleaved sequences of length
+// n: element k of sequence b is a[k * batch + b]. `roots` holds
+// exp(-+2 pi i k / n) for k < n / 2 and `reversed` the bit-reversal table.
+void fft(std::complex<double> *a, int n, int batch,
+         const std::complex<double> *roots, const int *reversed) noexcept {
+    for (int i = 0; i < n; ++i)
+        if (int j = reversed[i]; i < j)
+            for (int b = 0; b < batch; ++b)
+                std::swap(a[i * batch + b], a[j * batch + b]);
+    for (int len = 2; len <= n; len <<= 1) {
+        int half = len / 2, step = n / len;
+        for (int i = 0; i < n; i += len)
+            for (int k = 0; k < half; ++k) {
+                std::complex<double> w = roots[k * step];
+                std::complex<double> *lo = a + (i + k) * batch;
+                std::complex<double> *hi = lo + half * batch;
+                for (int b = 0; b < batch; ++b) {
+                    std::complex<double> v = hi[b] * w;
+                    hi[b] = lo[b] - v;
+                    lo[b] += v;
+                }
+            }
+    }
+}
+} // namespace
+
+ParticleMesh::ParticleMesh(int gridSize, MassAssignment assignment,
+                           bool shortRange)
+    : assignment_{assignment}, shortRange_{shortRange} {
+    setGridSize(gridSize);
+}
+
+void ParticleMesh::setGridSize(int n) noexcept {
+    gridSize_ = int(std::bit_ceil(unsigned(std::clamp(n, MIN_GRID, MAX_GRID))));
+}
+
+void ParticleMesh::fitGrid(const ParticleStore &store) {
+    size_t n = store.size();
+    glm::dvec3 lo = store.position(0), hi = lo;
+    for (size_t i = 1; i < n; ++i) {
+        glm::dvec3 p = store.position(i);
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+    glm::dvec3 extent = hi - lo;
+    double widest = std::max({extent.x, extent.y, extent.z, 1e-6});
+
+    int cells = gridSize_ - 1 - 2 * MARGIN;
+    h_ = std::exp2(std::ceil(std::log2(widest / cells) * CELL_STEPS) /
+                   CELL_STEPS);
+    origin_ = (lo + hi) * 0.5 - glm::dvec3(0.5 * h_ * (gridSize_ - 1));
+    dims_ = {gridSize_, gridSize_, gridSize_};
+    padded_ = {2 * gridSize_, 2 * gridSize_, 2 * gridSize_};
+}
+
+void ParticleMesh::deposit(const ParticleStore &store, bool plane) {
+    size_t total = size_t(padded_[0]) * padded_[1] * padded_[2];
+    work_.assign(total, Complex{});
+
+    // Serial: scattered writes from several threads would collide, and the
+    // deposit is cheap next to the transforms.
+    for (size_t i = 0, n = store.size(); i < n; ++i) {
+        glm::dvec3 u = (store.position(i) - origin_) / h_;
+        Window wx = window(u.x, assignment_);
+        Window wy = plane ? FLAT : window(u.y, assignment_);
+        Window wz = window(u.z, assignment_);
+        if (wx.first < 0 || wz.first < 0 || wy.first < 0 ||
+            wx.first + wx.count > dims_[0] ||
+            wy.first + wy.count > dims_[1] || wz.first + wz.count > dims_[2])
+            continue;
+        for (int c = 0; c < wz.count; ++c)
+            for (int b = 0; b < wy.count; ++b)
+                for (int a = 0; a < wx.count; ++a)
+                    work_[paddedIndex(wx.first + a, wy.first + b,
+                                      wz.first + c)] +=
+                        store.m[i] * wx.w[a] * wy.w[b] * wz.w[c];
+    }
+}
+
+void ParticleMesh::transform(std::vector<Complex> &data, bool inverse,
+                             bool pruned) {
+    int length = std::max({padded_[0], padded_[1], padded_[2]});
+    if (int(reversed_.size()) != length) {
+        reversed_.resize(length);
+        roots_.resize(length / 2);
+        inverseRoots_.resize(length / 2);
+        int bits = std::countr_zero(unsigned(length));
+        reversed_[0] = 0;
+        for (int i = 1; i < length; ++i)
+            reversed_[i] = (reversed_[i >> 1] >> 1) | ((i & 1) << (bits - 1));
+        for (int k = 0; k < length / 2; ++k) {
+            roots_[k] = std::polar(1.0, -2.0 * std::numbers::pi * k / length);
+            inverseRoots_[k] = std::conj(roots_[k]);
+        }
+    }
+    const Complex *roots = inverse ? inverseRoots_.data() : roots_.data();
+
+    // Every axis is transformed over lines along it. Lines that lie outside
+    // the first octant on an axis yet to be transformed (forward) or
+    // already transformed (inverse) are all zeros, or not needed.
+    const size_t strides[3] = {1, size_t(padded_[0]),
+                               size_t(padded_[0]) * padded_[1]};
+    for (int step = 0; step < 3; ++step) {
+        int axis = inverse ? 2 - step : step;
+        int len = padded_[axis];
+        if (len == 1)
+            continue;
+        int u = axis == 0 ? 1 : 0, v = axis == 2 ? 1 : 2;
+        int uCount = pruned && u > axis ? dims_[u] : padded_[u];
+        int vCount = pruned && v > axis ? dims_[v] : padded_[v];
+        // Neighbouring lines along x are transformed together so strided
+        // axes still read whole cache lines.
+        int batch = axis == 0 ? 1 : std::min(BATCH, uCount);
+        int blocks = (uCount + batch - 1) / batch;
+        size_t stride = strides[axis];
+
+        ThreadPool::shared().parallelFor(
+            size_t(vCount) * blocks, 4, [&](size_t begin, size_t end) {
+                thread_local std::vector<Complex> lines;
+                lines.resize(size_t(len) * batch);
+                for (size_t t = begin; t < end; ++t) {
+                    int first = int(t % blocks) * batch;
+                    int width = std::min(batch, uCount - first);
+                    size_t base = (t / blocks) * strides[v] +
+                                  size_t(first) * strides[u];
+                    for (int k = 0; k < len; ++k)
+                        for (int b = 0; b < width; ++b)
+                            lines[k * batch + b] =
+                                data[base + k * stride + b * strides[u]];
+                    fft(lines.data(), len, batch, roots, reversed_.data());
+                    for (int k = 0; k < len; ++k)
+                        for (int b = 0; b < width; ++b)
+                            data[base + k * stride + b * strides[u]] =
+                                lines[k * batch + b];
+                }
+            });
+    }
+}
+
+void ParticleMesh::buildGreen(double softening, double split) {
+    GreenKey key{dims_, h_, softening, split};
+    if (key == greenKey_)
+        return;
+
+    // Displacements wrap so the padded half holds the negative ones.
+    greenHat_.resize(size_t(padded_[0]) * padded_[1] * padded_[2]);
+    auto wrap = [](int i, int len) { return i < len - i ? i : i - len; };
+    for (int z = 0; z < padded_[2]; ++z)
+        for (int y = 0; y < padded_[1]; ++y)
+            for (int x = 0; x < padded_[0]; ++x) {
+                glm::dvec3 d(wrap(x, padded_[0]), wrap(y, padded_[1]),
+                             wrap(z, padded_[2]));
+                greenHat_[paddedIndex(x, y, z)] =
+                    green(glm::length(d) * h_, softening, split);
+            }
+    transform(greenHat_, false, false);
+    greenKey_ = key;
+}
+
+void ParticleMesh::solve(double softening, double split) {
+    buildGreen(softening, split);
+    transform(work_, false, true);
+    for (size_t i = 0; i < work_.size(); ++i)
+        work_[i] *= greenHat_[i];
+    transform(work_, true, true);
+
+    double scale = 1.0 / double(work_.size());
+    phi_.resize(size_t(dims_[0]) * dims_[1] * dims_[2]);
+    for (int z = 0; z < dims_[2]; ++z)
+        for (int y = 0; y < dims_[1]; ++y)
+            for (int x = 0; x < dims_[0]; ++x)
+                phi_[nodeIndex(x, y, z)] =
+                    work_[paddedIndex(x, y, z)].real() * scale;
+}
+
+void ParticleMesh::computeField() {
+    for (auto &f : field_)
+        f.resize(phi_.size());
+
+    // Four-point central difference; bodies stay MARGIN nodes inside, so
+    // the clamped edge values are never interpolated.
+    double inv12h = 1.0 / (12.0 * h_);
+    int n = gridSize_;
+    ThreadPool::shared().parallelFor(n, 1, [&](size_t begin, size_t end) {
+        auto at = [&](glm::ivec3 c) {
+            c = glm::clamp(c, 0, n - 1);
+            return phi_[nodeIndex(c.x, c.y, c.z)];
+        };
+        for (int z = int(begin); z < int(end); ++z)
+            for (int y = 0; y < n; ++y)
+                for (int x = 0; x < n; ++x) {
+                    glm::ivec3 c(x, y, z);
+                    size_t i = nodeIndex(x, y, z);
+                    for (int axis = 0; axis < 3; ++axis) {
+                        glm::ivec3 d(0);
+                        d[axis] = 1;
+                        field_[axis][i] = -(8.0 * (at(c + d) - at(c - d)) -
+                                            (at(c + 2 * d) - at(c - 2 * d))) *
+                                          inv12h;
+                    }
+                }
+    });
+}
+
+glm::dvec3 ParticleMesh::interpolate(const glm::dvec3 &p) const noexcept {
+    glm::dvec3 u = (p - origin_) / h_;
+    Window wx = window(u.x, assignment_);
+    Window wy = window(u.y, assignment_);
+    Window wz = window(u.z, assignment_);
+    glm::dvec3 a(0.0);
+    for (int c = 0; c < wz.count; ++c)
+        for (int b = 0; b < wy.count; ++b)
+            for (int k = 0; k < wx.count; ++k) {
+                size_t i =
+                    nodeIndex(wx.first + k, wy.first + b, wz.first + c);
+                double w = wx.w[k] * wy.w[b] * wz.w[c];
+                a += w * glm::dvec3(field_[0][i], field_[1][i], field_[2][i]);
+            }
+    return a;
+}
+
+void ParticleMesh::buildChainingMesh(const ParticleStore &store,
+                                     double cutoff) {
+    // Cells at least one cutoff wide over the mesh's own box, so every
+    // neighbour lies in the 27 surrounding cells.
+    int cells = std::max(1, int((gridSize_ - 1) * h_ / cutoff));
+    chainDims_ = {cells, cells, cells};
+    chainOrigin_ = origin_;
+    chainCell_ = (gridSize_ - 1) * h_ / cells;
+
+    size_t n = store.size();
+    size_t total = size_t(cells) * cells * cells;
+    chainStart_.assign(total + 1, 0);
+    chainCellOf_.resize(n);
+    chainOrder_.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        glm::ivec3 c = glm::clamp(
+            glm::ivec3((store.position(i) - chainOrigin_) / chainCell_), 0,
+            cells - 1);
+        chainCellOf_[i] = uint32_t((size_t(c.z) * cells + c.y) * cells + c.x);
+        ++chainStart_[chainCellOf_[i] + 1];
+    }
+    for (size_t c = 0; c < total; ++c)
+        chainStart_[c + 1] += chainStart_[c];
+    // Filling advances each cell's start to the next cell's; shift back.
+    for (size_t i = 0; i < n; ++i)
+        chainOrder_[chainStart_[chainCellOf_[i]]++] = uint32_t(i);
+    for (size_t c = total; c > 0; --c)
+        chainStart_[c] = chainStart_[c - 1];
+    chainStart_[0] = 0;
+}
+
+// Exact softened pair force minus what the mesh already carries for it.
+glm::dvec3 ParticleMesh::shortRange(const ParticleStore &store, uint32_t i,
+                                    double softening, double split,
+                                    double cutoff) const noexcept {
+    const double invSplitSqrtPi = std::numbers::inv_sqrtpi / split;
+    const double smallLimit =
+        invSplitSqrtPi / (6.0 * split * split); // long-range part as r -> 0
+    glm::dvec3 p = store.position(i);
+    glm::ivec3 c = glm::clamp(glm::ivec3((p - chainOrigin_) / chainCell_), 0,
+                              chainDims_[0] - 1);
+    int cells = chainDims_[0];
+
+    glm::dvec3 a(0.0);
+    for (int z = std::max(c.z - 1, 0); z <= std::min(c.z + 1, cells - 1); ++z)
+        for (int y = std::max(c.y - 1, 0); y <= std::min(c.y + 1, cells - 1);
+             ++y)
+            for (int x = std::max(c.x - 1, 0);
+                 x <= std::min(c.x + 1, cells - 1); ++x) {
+                size_t cell = (size_t(z) * cells + y) * cells + x;
+                for (uint32_t k = chainStart_[cell];
+                     k < chainStart_[cell + 1]; ++k) {
+                    uint32_t j = chainOrder_[k];
+                    glm::dvec3 d = store.position(j) - p;
+                    double r2 = glm::dot(d, d);
+                    if (j == i || r2 >= cutoff * cutoff)
+                        continue;
+                    double soft = r2 + softening;
+                    double direct = 1.0 / (soft * std::sqrt(soft));
+                    double r = std::sqrt(r2);
+                    double longRange =
+                        r < 1e-3 * split
+                            ? smallLimit
+                            : (std::erf(r / (2.0 * split)) / r -
+                               invSplitSqrtPi *
+                                   std::exp(-r2 / (4.0 * split * split))) /
+                                  r2;
+                    a += store.m[j] * (direct - longRange) * d;
+                }
+            }
+    return a;
+}
+
+void ParticleMesh::computeAccelerations(ParticleStore &store, double G,
+                                        double softening) {
+    computeAccelerations(store, {}, G, softening);
+}
+
+void ParticleMesh::computeAccelerations(ParticleStore &store,
+                                        std::span<const uint32_t> targets,
+                                        double G, double softening) {
+    if (store.empty())
+        return;
+    fitGrid(store);
+    deposit(store, false);
+    double split = shortRange_ ? SPLIT_CELLS * h_ : 0.0;
+    double cutoff = CUTOFF_SPLITS * split;
+    solve(softening, split);
+    computeField();
+    if (shortRange_)
+        buildChainingMesh(store, cutoff);
+
+    size_t count = targets.empty() ? store.size() : targets.size();
+    ThreadPool::shared().parallelFor(count, 256, [&](size_t b, size_t e) {
+        for (size_t k = b; k < e; ++k) {
+            uint32_t i = targets.empty() ? uint32_t(k) : targets[k];
+            glm::dvec3 a = interpolate(store.position(i));
+            if (shortRange_)
+                a += shortRange(store, i, softening, split, cutoff);
+            store.setAcceleration(i, G * a);
+        }
+    });
+}
+
+void ParticleMesh::solvePlane(const ParticleStore &store, double softening,
+                              const glm::dvec2 &center, double halfSize) {
+    dims_ = {gridSize_, 1, gridSize_};
+    padded_ = {2 * gridSize_, 1, 2 * gridSize_};
+    h_ = 2.0 * halfSize / (gridSize_ - 1);
+    origin_ = glm::dvec3(center.x - halfSize, 0.0, center.y - halfSize);
+    deposit(store, true);
+    solve(softening, 0.0);
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "ParticleStore.h"
+#include <array>
+#include <complex>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <span>
+#include <vector>
+
+enum class MassAssignment { CIC, TSC };
+
+// Particle-mesh gravity: masses are assigned to a cubic grid around the
+// bodies, the potential is the FFT convolution of that grid with the
+// softened Green's function on a zero-padded (isolated) grid, and the
+// central-difference field is interpolated back with the same assignment
+// window. O(N + M log M) for M grid cells, so it suits large, smooth
+// distributions; forces are only resolved down to a few cells.
+//
+// With the short-range correction (P³M) the mesh only carries the
+// erf-smoothed long-range part and pairs closer than a few cells are
+// summed directly over a chaining mesh, recovering close encounters.
+class ParticleMesh {
+  public:
+    explicit ParticleMesh(int gridSize = 32,
+                          MassAssignment assignment = MassAssignment::TSC,
+                          bool shortRange = false);
+
+    // Rounded up to a power of two in [MIN_GRID, MAX_GRID].
+    void setGridSize(int n) noexcept;
+    int getGridSize() const noexcept { return gridSize_; }
+    void setAssignment(MassAssignment a) noexcept { assignment_ = a; }
+    MassAssignment getAssignment() const noexcept { return assignment_; }
+    void setShortRange(bool on) noexcept { shortRange_ = on; }
+    bool getShortRange() const noexcept { return shortRange_; }
+
+    void computeAccelerations(ParticleStore &store, double G,
+                              double softening);
+    // Solves the mesh over every body but only interpolates for `targets`.
+    void computeAccelerations(ParticleStore &store,
+                              std::span<const uint32_t> targets, double G,
+                              double softening);
+
+    // Potential per unit G of the bodies projected onto the xz plane,
+    // sampled on a gridSize² lattice of nodes spanning
+    // [center - halfSize, center + halfSize]; bodies outside it are left
+    // out. Drives GravityWell's grid mode.
+    void solvePlane(const ParticleStore &store, double softening,
+                    const glm::dvec2 &center, double halfSize);
+
+    // Node values of the last solve, x fastest; gridSize² after
+    // solvePlane(), gridSize³ after computeAccelerations().
+    std::span<const double> potential() const noexcept { return phi_; }
+    const glm::dvec3 &origin() const noexcept { return origin_; }
+    double cellSize() const noexcept { return h_; }
+
+    static constexpr int MIN_GRID = 8;
+    static constexpr int MAX_GRID = 256;
+
+  private:
+    // Nodes kept clear of the grid edge so the assignment window and the
+    // four-point difference never leave it.
+    static constexpr int MARGIN = 3;
+    // Split radius in cells and the short-range cutoff in split radii.
+    static constexpr double SPLIT_CELLS = 1.25;
+    static constexpr double CUTOFF_SPLITS = 4.5;
+    // Strided FFT lines transformed together.
+    static constexpr int BATCH = 8;
+
+    using Complex = std::complex<double>;
+
+    int gridSize_;
+    MassAssignment assignment_;
+    bool shortRange_;
+
+    std::array<int, 3> dims_{};   // grid nodes per axis, 1 for a flat axis
+    std::array<int, 3> padded_{}; // FFT lengths, 2 * dims_ unless flat
+    glm::dvec3 origin_{0.0};      // position of node (0, 0, 0)
+    double h_ = 1.0;
+
+    std::vector<Complex> work_;
+    std::vector<Complex> greenHat_;
+    std::vector<Complex> roots_, inverseRoots_; // exp(-+2 pi i k / padded)
+    std::vector<int> reversed_;                 // bit reversal of k < padded
+    // What greenHat_ was built for.
+    struct GreenKey {
+        std::array<int, 3> dims{};
+        double h = 0.0, softening = -1.0, split = 0.0;
+        bool operator==(const GreenKey &) const = default;
+    } greenKey_;
+
+    std::vector<double> phi_;
+    std::array<std::vector<double>, 3> field_; // -grad phi per unit G
+
+    // Chaining mesh for the short-range sum.
+    std::array<int, 3> chainDims_{};
+    glm::dvec3 chainOrigin_{0.0};
+    double chainCell_ = 1.0;
+    std::vector<uint32_t> chainStart_, chainOrder_, chainCellOf_;
+
+    void fitGrid(const ParticleStore &store);
+    void deposit(const ParticleStore &store, bool plane);
+    void solve(double softening, double split);
+    void buildGreen(double softening, double split);
+    // `pruned` skips lines that are all zeros (forward) or whose results
+    // lie outside the grid (inverse), valid when the input is the grid.
+    void transform(std::vector<Complex> &data, bool inverse, bool pruned);
+    void computeField();
+    glm::dvec3 interpolate(const glm::dvec3 &p) const noexcept;
+
+    void buildChainingMesh(const ParticleStore &store, double cutoff);
+    glm::dvec3 shortRange(const ParticleStore &store, uint32_t i,
+                          double softening, double split,
+                          double cutoff) const noexcept;
+
+    size_t nodeIndex(int x, int y, int z) const noexcept {
+        return (size_t(z) * dims_[1] + y) * dims_[0] + x;
+    }
+    size_t paddedIndex(int x, int y, int z) const noexcept {
+        return (size_t(z) * padded_[1] + y) * padded_[0] + x;
+    }
+};
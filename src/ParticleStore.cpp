@@ -0,0 +1,43 @@
+#include "ParticleStore.h"
+
+#include <algorithm>
+
+static size_t padTo(size_t n, size_t lanes) {
+    return (n + lanes - 1) / lanes * lanes;
+}
+
+void ParticleStore::resizeArrays(size_t padded) {
+    for (auto *a : {&px, &py, &pz, &vx, &vy, &vz, &ax, &ay, &az, &m})
+        a->resize(padded, 0.0);
+}
+
+size_t ParticleStore::add(double mass, const glm::dvec3 &pos,
+                          const glm::dvec3 &vel) {
+    size_t i = count_++;
+    if (count_ > paddedSize())
+        resizeArrays(padTo(count_, LANES));
+
+    setPosition(i, pos);
+    setVelocity(i, vel);
+    setAcceleration(i, glm::dvec3{0.0});
+    m[i] = mass;
+    return i;
+}
+
+void ParticleStore::reserve(size_t n) {
+    for (auto *a : {&px, &py, &pz, &vx, &vy, &vz, &ax, &ay, &az, &m})
+        a->reserve(padTo(n, LANES));
+}
+
+void ParticleStore::resize(size_t n) {
+    resizeArrays(padTo(n, LANES));
+    for (auto *a : {&px, &py, &pz, &vx, &vy, &vz, &ax, &ay, &az, &m})
+        std::fill(a->begin() + n, a->end(), 0.0);
+    count_ = n;
+}
+
+void ParticleStore::clear() noexcept {
+    for (auto *a : {&px, &py, &pz, &vx, &vy, &vz, &ax, &ay, &az, &m})
+        a->clear();
+    count_ = 0;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <glm/glm.hpp>
+#include <new>
+#include <vector>
+
+template <class T, size_t Align = 64> struct AlignedAllocator {
+    using value_type = T;
+    template <class U> struct rebind {
+        using other = AlignedAllocator<U, Align>;
+    };
+
+    AlignedAllocator() noexcept = default;
+    template <class U>
+    AlignedAllocator(const AlignedAllocator<U, Align> &) noexcept {}
+
+    T *allocate(size_t n) {
+        return static_cast<T *>(
+            ::operator new[](n * sizeof(T), std::align_val_t{Align}));
+    }
+    void deallocate(T *p, size_t) noexcept {
+        ::operator delete[](p, std::align_val_t{Align});
+    }
+
+    friend bool operator==(const AlignedAllocator &,
+                           const AlignedAllocator &) noexcept {
+        return true;
+    }
+};
+
+template <class T> using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// Structure-of-arrays particle state shared by the integrator and every
+// force backend. Each array is padded to a multiple of LANES with massless
+// particles at the origin, so vector kernels never need a remainder loop.
+class ParticleStore {
+  public:
+    static constexpr size_t LANES = 8;
+
+    size_t add(double mass, const glm::dvec3 &pos, const glm::dvec3 &vel);
+    void reserve(size_t n);
+    void clear() noexcept;
+    // Sets the body count to n; bodies past the old count start zeroed.
+    void resize(size_t n);
+
+    size_t size() const noexcept { return count_; }
+    size_t paddedSize() const noexcept { return m.size(); }
+    bool empty() const noexcept { return count_ == 0; }
+
+    glm::dvec3 position(size_t i) const noexcept {
+        return {px[i], py[i], pz[i]};
+    }
+    glm::dvec3 velocity(size_t i) const noexcept {
+        return {vx[i], vy[i], vz[i]};
+    }
+    glm::dvec3 acceleration(size_t i) const noexcept {
+        return {ax[i], ay[i], az[i]};
+    }
+    void setPosition(size_t i, const glm::dvec3 &p) noexcept {
+        px[i] = p.x;
+        py[i] = p.y;
+        pz[i] = p.z;
+    }
+    void setVelocity(size_t i, const glm::dvec3 &v) noexcept {
+        vx[i] = v.x;
+        vy[i] = v.y;
+        vz[i] = v.z;
+    }
+    void setAcceleration(size_t i, const glm::dvec3 &a) noexcept {
+        ax[i] = a.x;
+        ay[i] = a.y;
+        az[i] = a.z;
+    }
+
+    AlignedVector<double> px, py, pz;
+    AlignedVector<double> vx, vy, vz;
+    AlignedVector<double> ax, ay, az;
+    AlignedVector<double> m;
+
+  private:
+    size_t count_ = 0;
+
+    void resizeArrays(size_t padded);
+};
@@ -1,114 +1,459 @@
 #include "PhysicsEngine.h"
 #include "ComputeShader.h"
+#include "GravityTuner.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <array>
 #include <cmath>
 
-// Suzuki–Yoshida 4th-order coefficients
-namespace {
-const double alpha = 1.0 / (2.0 - std::cbrt(2.0));
-const double beta = -std::cbrt(2.0) / (2.0 - std::cbrt(2.0));
-const double gamma = alpha;
+// Must match gravity.comp
+static constexpr double G_CONST = 0.5;
+static constexpr double SOFTENING = 0.01;
 
-const double d1 = alpha * 0.5;
-const double d2 = (alpha + beta) * 0.5;
-const double d3 = (beta + gamma) * 0.5;
-const double d4 = gamma * 0.5;
+namespace {
+// Block timestep criteria: dt = sqrt(2 eta eps / |a|) on the softening
+// length, tightened by dt = eta |a| / |jerk| once a jerk estimate exists.
+const double ETA_ACCEL = 0.025;
+const double ETA_JERK = 0.05;
+const double SOFTENING_LENGTH = std::sqrt(SOFTENING);
 
-const double k1 = alpha;
-const double k2 = beta;
-const double k3 = gamma;
+void kickBody(ParticleStore &s, size_t i, double h) {
+    s.vx[i] += s.ax[i] * h;
+    s.vy[i] += s.ay[i] * h;
+    s.vz[i] += s.az[i] * h;
+}
 
-void doDrift(std::vector<CelestialBody *> &bodies,
-             const std::vector<glm::dvec3> &vels, double h) {
-    for (size_t i = 0; i < bodies.size(); ++i)
-        bodies[i]->setPosition(bodies[i]->getPosition() + vels[i] * h);
+void doDrift(ParticleStore &s, double h) {
+    size_t n = s.size();
+    double *px = s.px.data(), *py = s.py.data(), *pz = s.pz.data();
+    const double *vx = s.vx.data(), *vy = s.vy.data(), *vz = s.vz.data();
+    for (size_t i = 0; i < n; ++i) {
+        px[i] += vx[i] * h;
+        py[i] += vy[i] * h;
+        pz[i] += vz[i] * h;
+    }
 }
 
-void doKick(std::vector<CelestialBody *> &bodies,
-            const std::vector<glm::dvec3> &accs, double h) {
-    for (size_t i = 0; i < bodies.size(); ++i)
-        bodies[i]->setVelocity(bodies[i]->getVelocity() + accs[i] * h);
+void doKick(ParticleStore &s, double h) {
+    size_t n = s.size();
+    double *vx = s.vx.data(), *vy = s.vy.data(), *vz = s.vz.data();
+    const double *ax = s.ax.data(), *ay = s.ay.data(), *az = s.az.data();
+    for (size_t i = 0; i < n; ++i) {
+        vx[i] += ax[i] * h;
+        vy[i] += ay[i] * h;
+        vz[i] += az[i] * h;
+    }
 }
 } // namespace
 
-PhysicsEngine::PhysicsEngine()
-    : gShader(std::make_unique<ComputeShader>("shaders/gravity.comp")) {}
+PhysicsEngine::PhysicsEngine(ForceBackend backend) : backend_{backend} {}
 
-void PhysicsEngine::addBody(std::unique_ptr<CelestialBody> body) {
-    bodies.push_back(std::move(body));
+size_t PhysicsEngine::addBody(double mass, const glm::dvec3 &pos,
+                              const glm::dvec3 &vel) {
+    syncToHost();
+    deviceStale_ = true;
+    accelCurrent_ = false;
+    return store_.add(mass, pos, vel);
 }
 
-std::vector<CelestialBody *> PhysicsEngine::getBodies() const {
-    std::vector<CelestialBody *> result;
-    result.reserve(bodies.size());
-    for (const auto &b : bodies)
-        result.push_back(b.get());
-    return result;
+void PhysicsEngine::restore(ParticleStore &&store) {
+    store_ = std::move(store);
+    hostStale_ = false;
+    deviceStale_ = true;
+    accelCurrent_ = false;
+    level_.clear();
+    jerk_.clear();
 }
 
-void PhysicsEngine::computeAccelerations() {
-    size_t n = bodies.size();
-    std::vector<glm::vec4> posMass(n);
+void PhysicsEngine::computeAccelerations(ForceBackend backend) {
+    PROFILE_ZONE("PhysicsEngine::computeAccelerations");
+    switch (backend) {
+    case ForceBackend::GpuDirect:
+        computeAccelerationsGpu();
+        break;
+    case ForceBackend::CpuDirect:
+        directSum_.computeAccelerations(store_, G_CONST, SOFTENING);
+        break;
+    case ForceBackend::BarnesHut:
+        barnesHut_.computeAccelerations(store_, G_CONST, SOFTENING);
+        break;
+    case ForceBackend::ParticleMesh:
+        particleMesh_.computeAccelerations(store_, G_CONST, SOFTENING);
+        break;
+    }
+}
+
+void PhysicsEngine::computeAccelerations(ForceBackend backend,
+                                         std::span<const uint32_t> targets) {
+    if (targets.empty())
+        return;
+    if (targets.size() == store_.size()) {
+        computeAccelerations(backend);
+        return;
+    }
+    PROFILE_ZONE("PhysicsEngine::computeAccelerations (subset)");
+    switch (backend) {
+    case ForceBackend::GpuDirect:
+        computeAccelerationsGpu(targets);
+        break;
+    case ForceBackend::CpuDirect:
+        directSum_.computeAccelerations(store_, targets, G_CONST, SOFTENING);
+        break;
+    case ForceBackend::BarnesHut:
+        barnesHut_.computeAccelerations(store_, targets, G_CONST, SOFTENING);
+        break;
+    case ForceBackend::ParticleMesh:
+        particleMesh_.computeAccelerations(store_, targets, G_CONST,
+                                           SOFTENING);
+        break;
+    }
+}
+
+double PhysicsEngine::totalEnergy() {
+    syncToHost();
+    size_t n = store_.size();
+    const ParticleStore &s = store_;
+
+    // Each chunk owns the pairs (i, j > i) for its i, so no atomics needed.
+    std::vector<double> partial(n, 0.0);
+    ThreadPool::shared().parallelFor(n, 64, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            double e = 0.5 * s.m[i] * glm::dot(s.velocity(i), s.velocity(i));
+            for (size_t j = i + 1; j < n; ++j) {
+                glm::dvec3 d = s.position(j) - s.position(i);
+                e -= G_CONST * s.m[i] * s.m[j] /
+                     std::sqrt(glm::dot(d, d) + SOFTENING);
+            }
+            partial[i] = e;
+        }
+    });
+    double total = 0.0;
+    for (double e : partial)
+        total += e;
+    return total;
+}
+
+double PhysicsEngine::compareBackends(ForceBackend reference,
+                                      ForceBackend candidate) {
+    syncToHost();
+    size_t n = store_.size();
+
+    computeAccelerations(reference);
+    std::vector<glm::dvec3> ref(n);
+    for (size_t i = 0; i < n; ++i)
+        ref[i] = store_.acceleration(i);
+
+    computeAccelerations(candidate);
+    double worst = 0.0;
     for (size_t i = 0; i < n; ++i) {
-        glm::dvec3 p = bodies[i]->getPosition();
-        posMass[i] = glm::vec4((float)p.x, (float)p.y, (float)p.z,
-                               (float)bodies[i]->getMass());
+        double norm = glm::length(ref[i]);
+        if (norm > 0.0)
+            worst = std::max(
+                worst, glm::length(store_.acceleration(i) - ref[i]) / norm);
+    }
+    // The store now holds the candidate's accelerations, not backend_'s.
+    accelCurrent_ = false;
+    return worst;
+}
+
+void PhysicsEngine::ensureGravityShader() {
+    if (gShader)
+        return;
+    if (!tiledKernel_) {
+        gShader = std::make_unique<ComputeShader>("shaders/gravity.comp");
+        return;
+    }
+    // Tuning binds its own scratch SSBOs, so it must run before ours are.
+    if (!kernelTuned_) {
+        kernelConfig_ = GravityTuner::loadOrTune();
+        kernelTuned_ = true;
+    }
+    gShader = std::make_unique<ComputeShader>(
+        "shaders/gravity_tiled.comp", GravityTuner::defines(kernelConfig_));
+}
+
+void PhysicsEngine::prepareGpu() {
+    ensureGravityShader();
+    if (gpuResident_ && !integrateShader) {
+        integrateShader =
+            std::make_unique<ComputeShader>("shaders/integrate.comp");
+        locKick_ = glGetUniformLocation(integrateShader->id(), "u_Kick");
+        locDrift_ = glGetUniformLocation(integrateShader->id(), "u_Drift");
+    }
+}
+
+void PhysicsEngine::setTiledKernel(bool on) {
+    if (on != tiledKernel_)
+        gShader.reset();
+    tiledKernel_ = on;
+}
+
+void PhysicsEngine::computeAccelerationsGpu(
+    std::span<const uint32_t> targets) {
+    ensureGravityShader();
+    size_t n = store_.size();
+    deviceStale_ = true;
+    std::span<glm::vec4> bodies = bodyStream_.next<glm::vec4>(n);
+    for (size_t i = 0; i < n; ++i)
+        bodies[i] = glm::vec4((float)store_.px[i], (float)store_.py[i],
+                              (float)store_.pz[i], (float)store_.m[i]);
+    std::span<const glm::vec4> accels = accelStream_.next<glm::vec4>(n);
+
+    bodyStream_.range().bind(GL_SHADER_STORAGE_BUFFER, 0);
+    accelStream_.range().bind(GL_SHADER_STORAGE_BUFFER, 1);
+    gShader->bind();
+    beginTimer(GpuTimers::Gravity);
+    gShader->dispatch((int)n);
+    endTimer(GpuTimers::Gravity);
+    bodyStream_.fence();
+    accelStream_.fence();
+    accelStream_.wait();
+
+    // The kernel always evaluates every body; only copy back the ones asked
+    // for so the rest keep the accelerations their own substeps rely on.
+    if (targets.empty())
+        for (size_t i = 0; i < n; ++i)
+            store_.setAcceleration(i, glm::dvec3(glm::vec3(accels[i])));
+    else
+        for (uint32_t i : targets)
+            store_.setAcceleration(i, glm::dvec3(glm::vec3(accels[i])));
+}
+
+void PhysicsEngine::uploadState() {
+    size_t n = store_.size();
+    staging_.resize(n);
+    stagingVel_.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        staging_[i] = glm::vec4((float)store_.px[i], (float)store_.py[i],
+                                (float)store_.pz[i], (float)store_.m[i]);
+        stagingVel_[i] = glm::vec4((float)store_.vx[i], (float)store_.vy[i],
+                                   (float)store_.vz[i], 0.0f);
     }
 
     if (!ssboBodies)
         glGenBuffers(1, &ssboBodies);
     if (!ssboAccels)
         glGenBuffers(1, &ssboAccels);
+    if (!ssboVelocities)
+        glGenBuffers(1, &ssboVelocities);
 
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, ssboBodies);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, n * sizeof(glm::vec4),
-                 posMass.data(), GL_DYNAMIC_DRAW);
+    // Uploads are rare (body count or backend changes), so storage is
+    // simply respecified at the current size.
+    GLsizeiptr bytes = n * sizeof(glm::vec4);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssboBodies);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, staging_.data(),
+                 GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssboVelocities);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, stagingVel_.data(),
+                 GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssboAccels);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, nullptr, GL_DYNAMIC_COPY);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_RGBA32F, GL_RGBA, GL_FLOAT,
+                      nullptr);
 
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, ssboBodies);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, ssboAccels);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, n * sizeof(glm::vec4), nullptr,
-                 GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, ssboVelocities);
 
-    gShader->bind();
-    gShader->dispatch((int)n);
+    deviceCount_ = n;
+    deviceStale_ = false;
+}
 
-    std::vector<glm::vec4> accels(n);
+void PhysicsEngine::syncToHost() {
+    if (!hostStale_)
+        return;
+
+    size_t n = deviceCount_;
+    staging_.resize(n);
+    stagingVel_.resize(n);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssboBodies);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, n * sizeof(glm::vec4),
+                       staging_.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssboVelocities);
     glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, n * sizeof(glm::vec4),
-                       accels.data());
+                       stagingVel_.data());
 
-    accelerations.resize(n);
-    for (size_t i = 0; i < n; ++i)
-        accelerations[i] = glm::dvec3(accels[i]);
+    for (size_t i = 0; i < n; ++i) {
+        store_.setPosition(i, glm::dvec3(glm::vec3(staging_[i])));
+        store_.setVelocity(i, glm::dvec3(glm::vec3(stagingVel_[i])));
+    }
+    hostStale_ = false;
 }
 
-void PhysicsEngine::step(double dt) {
-    if (bodies.empty())
+void PhysicsEngine::dispatchKickDrift(double kick, double drift) {
+    integrateShader->bind();
+    glUniform1f(locKick_, static_cast<float>(kick));
+    glUniform1f(locDrift_, static_cast<float>(drift));
+    integrateShader->dispatch(static_cast<int>(deviceCount_));
+}
+
+void PhysicsEngine::stepGpuResident(double dt) {
+    prepareGpu();
+    if (deviceStale_ || deviceCount_ != store_.size())
+        uploadState();
+    else {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, ssboBodies);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, ssboAccels);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, ssboVelocities);
+    }
+
+    // Each kick is fused with the drift that follows it into one pass.
+    const Integrators::Info &scheme = Integrators::info(integrator_);
+    int n = static_cast<int>(deviceCount_);
+    beginTimer(GpuTimers::Resident);
+    dispatchKickDrift(0.0, scheme.drift[0] * dt);
+    for (size_t i = 0; i < scheme.kick.size(); ++i) {
+        gShader->bind();
+        gShader->dispatch(n);
+        dispatchKickDrift(scheme.kick[i] * dt, scheme.drift[i + 1] * dt);
+    }
+    endTimer(GpuTimers::Resident);
+
+    hostStale_ = true;
+    accelCurrent_ = false;
+    forceEvaluations_ += scheme.kick.size() * deviceCount_;
+}
+
+void PhysicsEngine::beginTimer(GpuTimers::Pass pass) noexcept {
+    if (!timers_)
         return;
+    timers_->beginFrame();
+    timers_->begin(pass);
+}
 
-    std::vector<CelestialBody *> rawBodies = getBodies();
-    size_t n = rawBodies.size();
-    velocities.resize(n);
-    for (size_t i = 0; i < n; ++i)
-        velocities[i] = rawBodies[i]->getVelocity();
+void PhysicsEngine::endTimer(GpuTimers::Pass pass) noexcept {
+    if (timers_)
+        timers_->end(pass);
+}
 
-    doDrift(rawBodies, velocities, d1 * dt);
-    computeAccelerations();
-    doKick(rawBodies, accelerations, k1 * dt);
+void PhysicsEngine::assignLevels(double h) {
+    size_t n = store_.size();
+    deepestLevel_ = 0;
+    for (size_t i = 0; i < n; ++i) {
+        double a = glm::length(store_.acceleration(i));
+        double dti = h;
+        if (a > 0.0) {
+            dti = std::min(dti,
+                           std::sqrt(2.0 * ETA_ACCEL * SOFTENING_LENGTH / a));
+            if (jerk_[i] > 0.0)
+                dti = std::min(dti, ETA_JERK * a / jerk_[i]);
+        }
+        int level = 0;
+        while (level < MAX_LEVEL && h / double(1 << level) > dti)
+            ++level;
+        level_[i] = static_cast<uint8_t>(level);
+        deepestLevel_ = std::max(deepestLevel_, level);
+    }
+}
 
-    for (size_t i = 0; i < n; ++i)
-        velocities[i] = rawBodies[i]->getVelocity();
-    doDrift(rawBodies, velocities, d2 * dt);
-    computeAccelerations();
-    doKick(rawBodies, accelerations, k2 * dt);
+// One kick-drift-kick leapfrog of length h over the current levels. Every
+// body drifts on the finest tick; a body on level l kicks at the ends of its
+// own substep of h / 2^l and is only re-evaluated at those ends.
+void PhysicsEngine::advanceLevels(double h) {
+    size_t n = store_.size();
+    uint32_t ticks = 1u << deepestLevel_;
+    double tick = h / ticks;
 
-    for (size_t i = 0; i < n; ++i)
-        velocities[i] = rawBodies[i]->getVelocity();
-    doDrift(rawBodies, velocities, d3 * dt);
-    computeAccelerations();
-    doKick(rawBodies, accelerations, k3 * dt);
+    for (uint32_t t = 0; t < ticks; ++t) {
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t stride = 1u << (deepestLevel_ - level_[i]);
+            if (t % stride == 0)
+                kickBody(store_, i, 0.5 * tick * stride);
+        }
 
-    for (size_t i = 0; i < n; ++i)
-        velocities[i] = rawBodies[i]->getVelocity();
-    doDrift(rawBodies, velocities, d4 * dt);
+        doDrift(store_, tick);
+
+        active_.clear();
+        for (size_t i = 0; i < n; ++i)
+            if ((t + 1) % (1u << (deepestLevel_ - level_[i])) == 0)
+                active_.push_back(static_cast<uint32_t>(i));
+
+        prevAccel_.resize(active_.size());
+        for (size_t k = 0; k < active_.size(); ++k)
+            prevAccel_[k] = store_.acceleration(active_[k]);
+
+        computeAccelerations(backend_, active_);
+        forceEvaluations_ += backend_ == ForceBackend::GpuDirect
+                                 ? n
+                                 : active_.size();
+
+        for (size_t k = 0; k < active_.size(); ++k) {
+            uint32_t i = active_[k];
+            double sub = tick * (1u << (deepestLevel_ - level_[i]));
+            jerk_[i] = glm::length(store_.acceleration(i) - prevAccel_[k]) /
+                       std::abs(sub);
+            kickBody(store_, i, 0.5 * sub);
+        }
+    }
+}
+
+// The selected composition applied to the block leapfrog instead of a
+// single global one; levels stay fixed for the whole step. Schemes that are
+// not leapfrog compositions fall back to Yoshida 4.
+void PhysicsEngine::stepBlock(double dt) {
+    size_t n = store_.size();
+    if (level_.size() != n) {
+        level_.resize(n, 0);
+        jerk_.resize(n, 0.0);
+    }
+    if (!accelCurrent_) {
+        computeAccelerations(backend_);
+        forceEvaluations_ += n;
+    }
+
+    const Integrators::Info &scheme = Integrators::info(integrator_);
+    std::span<const double> weights =
+        scheme.composition ? scheme.kick
+                           : Integrators::info(Integrator::Yoshida4).kick;
+
+    // Levels hold for every sweep, so they must suit the longest one:
+    // composition weights reach about 2 in magnitude.
+    double longest = 0.0;
+    for (double w : weights)
+        longest = std::max(longest, std::abs(w));
+    assignLevels(longest * dt);
+    for (double w : weights)
+        advanceLevels(w * dt);
+
+    // Every body finishes on the last tick, so its acceleration is current.
+    accelCurrent_ = true;
+}
+
+template <const auto &S> void PhysicsEngine::stepWith(double dt) {
+    forceEvaluations_ += S.kick.size() * store_.size();
+    Integrators::step<S>(
+        dt, [this](double h) { doDrift(store_, h); },
+        [this](double h) { doKick(store_, h); },
+        [this] { computeAccelerations(backend_); });
+}
+
+void PhysicsEngine::step(double dt) {
+    PROFILE_ZONE("PhysicsEngine::step");
+    if (store_.empty())
+        return;
+
+    if (gpuResident_ && backend_ == ForceBackend::GpuDirect) {
+        stepGpuResident(dt);
+        return;
+    }
+    syncToHost();
+    deviceStale_ = true;
+
+    if (blockTimesteps_) {
+        stepBlock(dt);
+        return;
+    }
+    accelCurrent_ = false;
+    deepestLevel_ = 0;
 
-    for (auto *b : rawBodies)
-        b->updateTrail(static_cast<float>(dt));
+    using StepFn = void (PhysicsEngine::*)(double);
+    static constexpr std::array<StepFn, Integrators::TABLE.size()> table{
+        &PhysicsEngine::stepWith<Integrators::LEAPFROG>,
+        &PhysicsEngine::stepWith<Integrators::FOREST_RUTH>,
+        &PhysicsEngine::stepWith<Integrators::YOSHIDA4>,
+        &PhysicsEngine::stepWith<Integrators::YOSHIDA6>,
+        &PhysicsEngine::stepWith<Integrators::YOSHIDA8>,
+    };
+    (this->*table[static_cast<size_t>(integrator_)])(dt);
 }
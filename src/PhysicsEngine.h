@@ -1,32 +1,153 @@
 #pragma once
 
-#include "CelestialBody.h"
+#include "BarnesHut.h"
 #include "ComputeShader.h"
+#include "DirectSum.h"
+#include "GpuTimers.h"
+#include "GravityTuner.h"
+#include "Integrators.h"
+#include "ParticleMesh.h"
+#include "ParticleStore.h"
+#include "StreamBuffer.h"
 #include <glad/glad.h>
+#include <cstdint>
 #include <glm/glm.hpp>
 #include <memory>
+#include <span>
 #include <vector>
 
+enum class ForceBackend { GpuDirect, CpuDirect, BarnesHut, ParticleMesh };
+
 class PhysicsEngine {
   public:
-    PhysicsEngine();
+    explicit PhysicsEngine(ForceBackend backend = ForceBackend::GpuDirect);
     ~PhysicsEngine() = default;
 
-    void addBody(std::unique_ptr<CelestialBody> body);
+    // Returns the particle index used by render views into the store.
+    size_t addBody(double mass, const glm::dvec3 &pos, const glm::dvec3 &vel);
     void step(double dt);
+    // Replaces every body, e.g. with a loaded checkpoint. Accelerations and
+    // block-timestep levels are recomputed on the next step.
+    void restore(ParticleStore &&store);
+
+    const ParticleStore &getStore() const noexcept { return store_; }
+    size_t bodyCount() const noexcept { return store_.size(); }
+
+    void setBackend(ForceBackend backend) noexcept {
+        backend_ = backend;
+        accelCurrent_ = false;
+    }
+    ForceBackend getBackend() const noexcept { return backend_; }
+    BarnesHut &getBarnesHut() noexcept { return barnesHut_; }
+    ParticleMesh &getParticleMesh() noexcept { return particleMesh_; }
+
+    // Keep positions and velocities in SSBOs and run the whole GPU-direct
+    // step as compute passes; host copies are refreshed by syncToHost().
+    void setGpuResident(bool on) noexcept { gpuResident_ = on; }
+    bool getGpuResident() const noexcept { return gpuResident_; }
+    void syncToHost();
+
+    // Times every gravity dispatch and resident step in `timers`, which
+    // must belong to the calling thread's context. Null stops timing.
+    void setGpuTimers(GpuTimers *timers) noexcept { timers_ = timers; }
+
+    // Builds (and on first run autotunes) the GPU kernels the current
+    // settings need, so the first GPU step() doesn't pay for it.
+    void prepareGpu();
+
+    // Shared-memory tiled direct sum with an autotuned launch configuration
+    // instead of the plain gravity.comp.
+    void setTiledKernel(bool on);
+    bool getTiledKernel() const noexcept { return tiledKernel_; }
+    const GravityTuner::Config &getKernelConfig() const noexcept {
+        return kernelConfig_;
+    }
+
+    // Splitting scheme used by every step path; higher orders cost more
+    // force evaluations per step (Integrators::info(i).kick.size()).
+    void setIntegrator(Integrator integrator) noexcept {
+        integrator_ = integrator;
+    }
+    Integrator getIntegrator() const noexcept { return integrator_; }
 
-    std::vector<CelestialBody *> getBodies() const;
+    // Hierarchical power-of-two block timesteps: each body advances with
+    // dt / 2^level, its level picked from acceleration and jerk at the start
+    // of every step, and only bodies finishing a substep get new forces.
+    // Ignored by the GPU-resident path.
+    void setBlockTimesteps(bool on) noexcept { blockTimesteps_ = on; }
+    bool getBlockTimesteps() const noexcept { return blockTimesteps_; }
+    int deepestLevel() const noexcept { return deepestLevel_; }
+
+    // Per-body force evaluations performed by step() so far.
+    uint64_t forceEvaluations() const noexcept { return forceEvaluations_; }
+
+    // Kinetic plus softened potential energy, O(N²) on the thread pool.
+    double totalEnergy();
+
+    // Largest |a - a_ref| / |a_ref| over all bodies at the current state.
+    double compareBackends(ForceBackend reference, ForceBackend candidate);
 
   private:
-    std::vector<std::unique_ptr<CelestialBody>> bodies;
-    std::vector<glm::dvec3> accelerations;
-    std::vector<glm::dvec3> velocities;
+    ParticleStore store_;
 
-    std::unique_ptr<ComputeShader> gShader =
-        std::make_unique<ComputeShader>("shaders/gravity.comp");
+    // Created on first use so CPU backends run without a GL context.
+    std::unique_ptr<ComputeShader> gShader;
+    bool tiledKernel_ = true;
+    bool kernelTuned_ = false;
+    GravityTuner::Config kernelConfig_;
+    std::unique_ptr<ComputeShader> integrateShader;
+    GLint locKick_ = -1, locDrift_ = -1;
+    GpuTimers *timers_ = nullptr;
 
+    // Per-evaluation transfers of the non-resident GPU path.
+    StreamBuffer bodyStream_;
+    StreamBuffer accelStream_{StreamBuffer::Readback};
+    // The resident path's state.
     GLuint ssboBodies = 0;
     GLuint ssboAccels = 0;
+    GLuint ssboVelocities = 0;
+    std::vector<glm::vec4> staging_;
+    std::vector<glm::vec4> stagingVel_;
+
+    bool gpuResident_ = false;
+    bool deviceStale_ = true; // host state newer than the SSBOs
+    bool hostStale_ = false;  // SSBOs newer than the host state
+    size_t deviceCount_ = 0;
+
+    ForceBackend backend_;
+    Integrator integrator_ = Integrator::Yoshida4;
+    BarnesHut barnesHut_;
+    DirectSum directSum_;
+    ParticleMesh particleMesh_;
+
+    static constexpr int MAX_LEVEL = 12;
+    bool blockTimesteps_ = false;
+    bool accelCurrent_ = false; // store_ accelerations match its positions
+    int deepestLevel_ = 0;
+    uint64_t forceEvaluations_ = 0;
+    std::vector<uint8_t> level_;
+    std::vector<double> jerk_; // |da/dt| over each body's last substep
+    std::vector<uint32_t> active_;
+    std::vector<glm::dvec3> prevAccel_;
+
+    void computeAccelerations(ForceBackend backend);
+    void computeAccelerations(ForceBackend backend,
+                              std::span<const uint32_t> targets);
+    // Empty targets means every body.
+    void computeAccelerationsGpu(std::span<const uint32_t> targets = {});
+    void ensureGravityShader();
+
+    template <const auto &Scheme> void stepWith(double dt);
+    void stepBlock(double dt);
+    // Levels such that each body's substep of h / 2^level meets its
+    // acceleration and jerk criteria.
+    void assignLevels(double h);
+    void advanceLevels(double h);
 
-    void computeAccelerations();
+    void stepGpuResident(double dt);
+    void uploadState();
+    // Each timed pass is a frame of timers_ of its own.
+    void beginTimer(GpuTimers::Pass pass) noexcept;
+    void endTimer(GpuTimers::Pass pass) noexcept;
+    void dispatchKickDrift(double kick, double drift);
 };
@@ -0,0 +1,196 @@
+#include "PhysicsThread.h"
+#include "Profiler.h"
+
+#include <GLFW/glfw3.h>
+#include <algorithm>
+
+using Clock = std::chrono::steady_clock;
+
+PhysicsThread::PhysicsThread(PhysicsEngine &engine, double fixedDt)
+    : engine_{engine}, fixedDt_{fixedDt} {}
+
+PhysicsThread::~PhysicsThread() noexcept { stop(); }
+
+void PhysicsThread::start(GLFWwindow *glContext) {
+    if (running_)
+        return;
+    glContext_ = glContext;
+
+    // Publish the initial state so the renderer has something to show
+    // before the first step completes.
+    publish(0.0);
+    snapshots_.acquire();
+
+    running_ = true;
+    thread_ = std::thread([this] { loop(); });
+}
+
+void PhysicsThread::stop() noexcept {
+    if (!running_.exchange(false))
+        return;
+    if (thread_.joinable())
+        thread_.join();
+}
+
+void PhysicsThread::post(std::function<void(PhysicsEngine &)> command) {
+    std::lock_guard lock(commandMutex_);
+    commands_.push_back(std::move(command));
+}
+
+void PhysicsThread::saveCheckpoint(std::string path,
+                                   Checkpoint::Writer &writer) {
+    post([this, path = std::move(path), &writer](PhysicsEngine &e) {
+        PROFILE_ZONE("PhysicsThread::saveCheckpoint");
+        e.syncToHost();
+        Checkpoint::Settings settings =
+            Checkpoint::capture(e, simTime_, steps_, fixedDt());
+        writer.submit(path, Checkpoint::encode(e.getStore(), settings));
+    });
+}
+
+void PhysicsThread::restore(std::shared_ptr<ParticleStore> store,
+                            const Checkpoint::Settings &settings) {
+    post([this, store, settings](PhysicsEngine &e) {
+        Checkpoint::apply(settings, e);
+        e.restore(std::move(*store));
+        fixedDt_.store(settings.dt, std::memory_order_relaxed);
+        simTime_ = settings.time;
+        steps_ = publishedSteps_ = settings.steps;
+        publishedEvals_ = e.forceEvaluations();
+        ++restores_;
+        // Nothing to interpolate from across the jump.
+        lastPublished_.clear();
+        lastPublishedTime_ = simTime_;
+        publish(0.0);
+    });
+}
+
+void PhysicsThread::record(std::shared_ptr<Trajectory::Recorder> recorder) {
+    post([this, recorder](PhysicsEngine &) { recorder_ = recorder; });
+}
+
+std::future<std::shared_ptr<Trajectory::Recorder>>
+PhysicsThread::stopRecording() {
+    // std::function needs a copyable command.
+    auto handBack =
+        std::make_shared<std::promise<std::shared_ptr<Trajectory::Recorder>>>();
+    post([this, handBack](PhysicsEngine &) {
+        if (recorder_)
+            recorder_->finish();
+        handBack->set_value(std::move(recorder_));
+        recorder_.reset();
+    });
+    return handBack->get_future();
+}
+
+void PhysicsThread::runCommands() {
+    {
+        std::lock_guard lock(commandMutex_);
+        executing_.swap(commands_);
+    }
+    for (auto &cmd : executing_)
+        cmd(engine_);
+    executing_.clear();
+}
+
+void PhysicsThread::publish(double stepMs) {
+    const ParticleStore &store = engine_.getStore();
+    size_t n = store.size();
+
+    PhysicsSnapshot &snap = snapshots_.back();
+    snap.curr.resize(n);
+    snap.mass.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        snap.curr[i] = store.position(i);
+        snap.mass[i] = store.m[i];
+    }
+
+    // Bodies added since the last publish have no previous position.
+    size_t old = std::min(lastPublished_.size(), n);
+    snap.prev.resize(n);
+    std::copy_n(lastPublished_.begin(), old, snap.prev.begin());
+    std::copy(snap.curr.begin() + old, snap.curr.end(),
+              snap.prev.begin() + old);
+
+    snap.prevTime = lastPublishedTime_;
+    snap.time = simTime_;
+    snap.publishedAt = Clock::now();
+    snap.steps = steps_;
+    snap.stepMs = stepMs;
+    if (timers_) {
+        snap.gravityGpuMs = timers_->averageMs(GpuTimers::Gravity);
+        snap.residentGpuMs = timers_->averageMs(GpuTimers::Resident);
+    }
+    snap.treeNodes = engine_.getBarnesHut().nodeCount();
+    snap.deepestLevel = engine_.deepestLevel();
+
+    uint64_t evals = engine_.forceEvaluations();
+    if (steps_ > publishedSteps_)
+        snap.evalsPerStep = double(evals - publishedEvals_) /
+                            double(steps_ - publishedSteps_);
+    publishedSteps_ = steps_;
+    publishedEvals_ = evals;
+    snap.kernel = engine_.getKernelConfig();
+    snap.restores = restores_;
+
+    lastPublished_.assign(snap.curr.begin(), snap.curr.end());
+    lastPublishedTime_ = simTime_;
+    snapshots_.publish();
+}
+
+void PhysicsThread::loop() {
+    Profiler::setThreadName("physics");
+    if (glContext_) {
+        glfwMakeContextCurrent(glContext_);
+        // Query objects aren't shared between contexts.
+        timers_ = std::make_unique<GpuTimers>();
+        engine_.setGpuTimers(timers_.get());
+    }
+
+    auto last = Clock::now();
+    double backlog = 0.0;
+
+    while (running_.load(std::memory_order_relaxed)) {
+        runCommands();
+
+        auto now = Clock::now();
+        backlog += std::chrono::duration<double>(now - last).count();
+        last = now;
+        backlog = std::min(backlog, MAX_BACKLOG);
+
+        // Only commands change it, so it holds until the next runCommands().
+        double dt = fixedDt();
+        if (backlog < dt) {
+            std::this_thread::sleep_for(
+                std::chrono::duration<double>(dt - backlog));
+            continue;
+        }
+
+        int stepped = 0;
+        auto begin = Clock::now();
+        while (backlog >= dt) {
+            engine_.step(dt);
+            simTime_ += dt;
+            backlog -= dt;
+            ++steps_;
+            ++stepped;
+            if (recorder_ && recorder_->due(steps_)) {
+                engine_.syncToHost();
+                recorder_->capture(engine_.getStore(), simTime_, steps_);
+            }
+        }
+        double ms =
+            std::chrono::duration<double, std::milli>(Clock::now() - begin)
+                .count();
+
+        PROFILE_ZONE("PhysicsThread::publish");
+        engine_.syncToHost();
+        publish(ms / stepped);
+    }
+
+    if (glContext_) {
+        engine_.setGpuTimers(nullptr);
+        timers_.reset();
+        glfwMakeContextCurrent(nullptr);
+    }
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "Checkpoint.h"
+#include "GpuTimers.h"
+#include "GravityTuner.h"
+#include "Trajectory.h"
+#include "PhysicsEngine.h"
+#include "TripleBuffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <glm/glm.hpp>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct GLFWwindow;
+
+// State published by the physics thread: the last two published positions
+// so the renderer can interpolate between them.
+struct PhysicsSnapshot {
+    double prevTime = 0.0;
+    double time = 0.0;
+    std::chrono::steady_clock::time_point publishedAt;
+    std::vector<glm::dvec3> prev;
+    std::vector<glm::dvec3> curr;
+    std::vector<double> mass;
+
+    uint64_t steps = 0;
+    double stepMs = 0.0;
+    // GPU time per gravity dispatch and per resident step, averaged over
+    // the physics thread's recent samples; 0 until there are any.
+    double gravityGpuMs = 0.0;
+    double residentGpuMs = 0.0;
+    size_t treeNodes = 0;
+    int deepestLevel = 0;
+    double evalsPerStep = 0.0;
+    GravityTuner::Config kernel;
+    // restore() calls applied so far, so readers can tell snapshots of
+    // replaced bodies apart.
+    uint64_t restores = 0;
+};
+
+// Runs PhysicsEngine::step at a fixed timestep on its own thread. All
+// engine mutation from other threads goes through post().
+class PhysicsThread {
+  public:
+    explicit PhysicsThread(PhysicsEngine &engine, double fixedDt = 0.01);
+    ~PhysicsThread() noexcept;
+
+    PhysicsThread(const PhysicsThread &) = delete;
+    PhysicsThread &operator=(const PhysicsThread &) = delete;
+
+    // glContext, if given, is made current on the physics thread so GPU
+    // backends work; it must share objects with the render context.
+    void start(GLFWwindow *glContext);
+    void stop() noexcept;
+    bool running() const noexcept { return running_.load(); }
+
+    void post(std::function<void(PhysicsEngine &)> command);
+
+    // Snapshots the engine between steps and hands the image to `writer`,
+    // which must outlive the command.
+    void saveCheckpoint(std::string path, Checkpoint::Writer &writer);
+    // Replaces the bodies, settings, clock and timestep between steps.
+    void restore(std::shared_ptr<ParticleStore> store,
+                 const Checkpoint::Settings &settings);
+
+    // Captures every recorder->due() step until stopRecording(), which
+    // finishes the recording and hands the recorder back through the
+    // future once the physics thread is done with it. Closing it, which
+    // joins the writer, is left to the caller, off the physics thread.
+    void record(std::shared_ptr<Trajectory::Recorder> recorder);
+    std::future<std::shared_ptr<Trajectory::Recorder>> stopRecording();
+
+    // Reader side of the snapshot triple buffer (render thread only).
+    bool acquire() noexcept { return snapshots_.acquire(); }
+    const PhysicsSnapshot &latest() const noexcept {
+        return snapshots_.front();
+    }
+
+    double fixedDt() const noexcept {
+        return fixedDt_.load(std::memory_order_relaxed);
+    }
+
+  private:
+    // Backlog beyond this is dropped so a stall slows the simulation down
+    // instead of making every following frame catch up.
+    static constexpr double MAX_BACKLOG = 0.25;
+
+    PhysicsEngine &engine_;
+    // Written by restore() on the physics thread, read by the UI.
+    std::atomic<double> fixedDt_;
+
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    GLFWwindow *glContext_ = nullptr;
+    std::unique_ptr<GpuTimers> timers_; // in glContext_, while running
+
+    std::mutex commandMutex_;
+    std::vector<std::function<void(PhysicsEngine &)>> commands_;
+    std::vector<std::function<void(PhysicsEngine &)>> executing_;
+
+    TripleBuffer<PhysicsSnapshot> snapshots_;
+    std::vector<glm::dvec3> lastPublished_;
+    double lastPublishedTime_ = 0.0;
+    double simTime_ = 0.0;
+    uint64_t steps_ = 0;
+    uint64_t publishedSteps_ = 0;
+    uint64_t publishedEvals_ = 0;
+    uint64_t restores_ = 0;
+    std::shared_ptr<Trajectory::Recorder> recorder_;
+
+    void loop();
+    void runCommands();
+    void publish(double stepMs);
+};
@@ -0,0 +1,229 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+constexpr size_t CAPACITY = size_t(1) << 15; // zones kept per thread
+
+struct Event {
+    const char *name;
+    int64_t begin, end;
+    uint32_t depth;
+};
+
+// One ring entry, guarded by a sequence number so readers can tell a
+// complete event from one being overwritten: seq is odd while zone `i` is
+// written into the slot and complete(i) once it is done.
+struct Slot {
+    std::atomic<uint64_t> seq{0};
+    std::atomic<const char *> name{nullptr};
+    std::atomic<int64_t> begin{0}, end{0};
+    std::atomic<uint32_t> depth{0};
+};
+
+constexpr uint64_t complete(uint64_t zone) noexcept { return 2 * zone + 2; }
+
+struct Ring {
+    std::string thread;
+    uint32_t id = 0;
+    uint32_t depth = 0;
+    std::atomic<uint64_t> head{0}; // zones ever written
+    std::array<Slot, CAPACITY> events;
+};
+
+// Rings live until exit so a finished thread's zones can still be read.
+std::mutex registryMutex;
+std::vector<std::unique_ptr<Ring>> rings;
+
+std::atomic<int64_t> frameBegin{0}, frameEnd{0};
+// Reader-side copy of one ring, shared by lastFrame and writeChromeTrace.
+std::mutex scratchMutex;
+std::vector<Event> scratch;
+
+Ring &ring() {
+    thread_local Ring *mine = [] {
+        std::lock_guard lock(registryMutex);
+        auto r = std::make_unique<Ring>();
+        r->id = uint32_t(rings.size()) + 1;
+        r->thread = "thread " + std::to_string(r->id);
+        rings.push_back(std::move(r));
+        return rings.back().get();
+    }();
+    return *mine;
+}
+
+// Copies zone `zone` out of its slot; false if the writer has moved on to
+// a later zone or is overwriting the slot right now.
+bool read(const Slot &slot, uint64_t zone, Event &e) noexcept {
+    uint64_t seq = slot.seq.load(std::memory_order_acquire);
+    e = {slot.name.load(std::memory_order_relaxed),
+         slot.begin.load(std::memory_order_relaxed),
+         slot.end.load(std::memory_order_relaxed),
+         slot.depth.load(std::memory_order_relaxed)};
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return seq == complete(zone) &&
+           slot.seq.load(std::memory_order_relaxed) == seq;
+}
+
+// Appends the zones of `r` that ended at or after `since`, skipping any the
+// writer overwrote while we copied. Zones are stored in the order they
+// ended, so the copy walks back from the newest.
+void copyRing(const Ring &r, std::vector<Event> &out,
+              int64_t since = INT64_MIN) {
+    uint64_t head = r.head.load(std::memory_order_acquire);
+    uint64_t oldest = head > CAPACITY ? head - CAPACITY : 0;
+    size_t begin = out.size();
+    Event e;
+    for (uint64_t i = head; i > oldest; --i) {
+        // A lapped slot means every older one is gone too.
+        if (!read(r.events[(i - 1) % CAPACITY], i - 1, e) || e.end < since)
+            break;
+        out.push_back(e);
+    }
+    std::reverse(out.begin() + begin, out.end());
+}
+
+void appendEscaped(std::string &out, const char *s) {
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\')
+            out += '\\';
+        out += *s;
+    }
+}
+} // namespace
+
+namespace Profiler {
+void setEnabled(bool on) noexcept {
+    detail::enabled.store(on, std::memory_order_relaxed);
+}
+
+void setThreadName(const char *name) {
+    Ring &r = ring();
+    std::lock_guard lock(registryMutex);
+    r.thread = name;
+}
+
+int64_t now() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+uint32_t enter() noexcept { return ring().depth++; }
+
+void leave(const char *name, int64_t begin, uint32_t depth) noexcept {
+    Ring &r = ring();
+    r.depth = depth;
+    uint64_t head = r.head.load(std::memory_order_relaxed);
+    Slot &slot = r.events[head % CAPACITY];
+    slot.seq.store(complete(head) - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.begin.store(begin, std::memory_order_relaxed);
+    slot.end.store(now(), std::memory_order_relaxed);
+    slot.depth.store(depth, std::memory_order_relaxed);
+    slot.seq.store(complete(head), std::memory_order_release);
+    r.head.store(head + 1, std::memory_order_release);
+}
+
+void markFrame() noexcept {
+    int64_t t = now();
+    frameBegin.store(frameEnd.load(std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+    frameEnd.store(t, std::memory_order_relaxed);
+}
+
+void lastFrame(std::vector<ZoneTotal> &out) {
+    out.clear();
+    int64_t begin = frameBegin.load(std::memory_order_relaxed);
+    int64_t end = frameEnd.load(std::memory_order_relaxed);
+    if (begin == 0 || end <= begin)
+        return;
+
+    std::lock_guard scratchLock(scratchMutex);
+    std::lock_guard lock(registryMutex);
+    for (const auto &r : rings) {
+        scratch.clear();
+        copyRing(*r, scratch, begin);
+        std::sort(scratch.begin(), scratch.end(),
+                  [](const Event &a, const Event &b) {
+                      return a.begin < b.begin;
+                  });
+        size_t first = out.size();
+        for (const Event &e : scratch) {
+            int64_t from = std::max(e.begin, begin);
+            int64_t to = std::min(e.end, end);
+            if (to <= from)
+                continue;
+            auto it = std::find_if(
+                out.begin() + first, out.end(), [&](const ZoneTotal &z) {
+                    return z.name == e.name && z.depth == e.depth;
+                });
+            if (it == out.end()) {
+                out.push_back({r->thread.c_str(), e.name, e.depth, 0, 0.0});
+                it = out.end() - 1;
+            }
+            ++it->calls;
+            it->ms += double(to - from) * 1e-6;
+        }
+    }
+}
+
+size_t writeChromeTrace(const std::string &path) {
+    std::string json = "{\"traceEvents\":[\n";
+    size_t written = 0;
+    {
+        std::lock_guard scratchLock(scratchMutex);
+        std::lock_guard lock(registryMutex);
+        int64_t origin = INT64_MAX;
+        for (const auto &r : rings) {
+            scratch.clear();
+            copyRing(*r, scratch);
+            for (const Event &e : scratch)
+                origin = std::min(origin, e.begin);
+        }
+
+        char buf[128];
+        for (const auto &r : rings) {
+            json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                    "\"tid\":" +
+                    std::to_string(r->id) + ",\"args\":{\"name\":\"";
+            appendEscaped(json, r->thread.c_str());
+            json += "\"}},\n";
+
+            scratch.clear();
+            copyRing(*r, scratch);
+            for (const Event &e : scratch) {
+                json += "{\"name\":\"";
+                appendEscaped(json, e.name);
+                std::snprintf(buf, sizeof(buf),
+                              "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                              "\"ts\":%.3f,\"dur\":%.3f},\n",
+                              r->id, double(e.begin - origin) * 1e-3,
+                              double(e.end - e.begin) * 1e-3);
+                json += buf;
+                ++written;
+            }
+        }
+    }
+    if (json.ends_with(",\n"))
+        json.erase(json.size() - 2, 1);
+    json += "],\"displayTimeUnit\":\"ms\"}\n";
+
+    std::FILE *f = std::fopen(path.c_str(), "wb");
+    if (!f)
+        throw std::runtime_error("cannot write trace " + path);
+    bool ok = std::fwrite(json.data(), 1, json.size(), f) == json.size();
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok)
+        throw std::runtime_error("cannot write trace " + path);
+    return written;
+}
+} // namespace Profiler
@@ -1,6 +1,9 @@
 #include "Renderer.h"
+#include "AssetCache.h"
 #include "CelestialBody.h"
+#include "Profiler.h"
 
+#include <algorithm>
 #include <format>
 #include <fstream>
 #include <glm/gtc/matrix_transform.hpp>
@@ -27,19 +30,17 @@ Renderer::Renderer(int w, int h)
                                       loadFile("shaders/trail.frag"))},
       wellProg_{Program::fromSources(loadFile("shaders/gravitywell.vert"),
                                      loadFile("shaders/gravitywell.frag"))},
-      gravityWell_{40.0f, 50} {
-
-    glGenQueries(1, &queryMeshID_);
-    glGenQueries(1, &queryTrailID_);
-    glGenQueries(1, &queryWellID_);
+      instancedProg_{
+          Program::fromSources(loadFile("shaders/body_instanced.vert"),
+                               loadFile("shaders/body_instanced.frag"))},
+      impostorProg_{
+          Program::fromSources(loadFile("shaders/body_impostor.vert"),
+                               loadFile("shaders/body_impostor.frag"))},
+      gravityWell_{200.0f, 4096}, sphere_{AssetCache::sphere()} {
     glViewport(0, 0, width_, height_);
 }
 
-Renderer::~Renderer() noexcept {
-    glDeleteQueries(1, &queryMeshID_);
-    glDeleteQueries(1, &queryTrailID_);
-    glDeleteQueries(1, &queryWellID_);
-};
+Renderer::~Renderer() noexcept = default;
 
 void Renderer::setViewportSize(int w, int h) noexcept {
     width_ = w;
@@ -47,27 +48,59 @@ void Renderer::setViewportSize(int w, int h) noexcept {
     glViewport(0, 0, width_, height_);
 }
 
-void Renderer::drawAll(const std::vector<CelestialBody *> &bodies,
-                       const glm::mat4 &view, const glm::mat4 &proj) noexcept {
+void Renderer::drawAll(
+    const std::vector<std::unique_ptr<CelestialBody>> &bodies,
+    const ParticleStore &store, const glm::mat4 &view,
+    const glm::mat4 &proj) {
+    PROFILE_ZONE("Renderer::drawAll");
+    timers_.beginFrame();
     glClearColor(0, 0, 0, 1);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    gravityWell_.updateFromBodies(bodies, 0.5f);
+    uploadBodies(store);
+    if (trails_.size() != store.size())
+        trails_.sync(bodies, store.size());
+
+    timers_.begin(GpuTimers::Compute);
+    trails_.update(bodyStream_.range(), view, 2.0f / (proj[1][1] * height_));
+    // Start the trail pass before the well refines on the CPU.
+    glFlush();
+    gravityWell_.update(store, bodyStream_.range(), 0.5f);
+    timers_.end(GpuTimers::Compute);
+
     wellProg_.use();
     {
         glm::mat4 mvp = proj * view;
         glUniformMatrix4fv(wellProg_.uniform("u_MVP"), 1, GL_FALSE,
                            glm::value_ptr(mvp));
     }
-    glBeginQuery(GL_PRIMITIVES_GENERATED, queryWellID_);
+    timers_.begin(GpuTimers::Well);
     gravityWell_.draw();
-    glEndQuery(GL_PRIMITIVES_GENERATED);
-    glGetQueryObjectuiv(queryWellID_, GL_QUERY_RESULT, &wellPrimitives_);
+    timers_.end(GpuTimers::Well);
 
-    bodyProg_.use();
+    timers_.begin(GpuTimers::Meshes);
+    if (instanced_)
+        drawBodiesInstanced(bodies, view, proj);
+    else
+        drawBodies(bodies, view, proj);
+    timers_.end(GpuTimers::Meshes);
+
+    glDepthMask(GL_FALSE);
+    glEnable(GL_DEPTH_TEST);
+    timers_.begin(GpuTimers::Trails);
+    trails_.draw(trailProg_, proj * view);
+    timers_.end(GpuTimers::Trails);
+
+    glDepthMask(GL_TRUE);
+    bodyStream_.fence();
+    meshListStream_.fence();
+}
 
-    glBeginQuery(GL_PRIMITIVES_GENERATED, queryMeshID_);
-    for (auto *b : bodies) {
+void Renderer::drawBodies(
+    const std::vector<std::unique_ptr<CelestialBody>> &bodies,
+    const glm::mat4 &view, const glm::mat4 &proj) noexcept {
+    bodyProg_.use();
+    for (const auto &b : bodies) {
         glm::mat4 model =
             glm::translate(glm::mat4{1.0f}, glm::vec3(b->getPosition())) *
             glm::scale(glm::mat4{1.0f}, glm::vec3(b->getScale()));
@@ -80,28 +113,137 @@ void Renderer::drawAll(const std::vector<CelestialBody *> &bodies,
         b->bindMeshAndTexture();
         b->drawMesh();
     }
+}
 
-    glEndQuery(GL_PRIMITIVES_GENERATED);
+void Renderer::uploadBodies(const ParticleStore &store) {
+    // Positions are interpolated on the CPU, so this is the one upload per
+    // frame; the layout matches the physics SSBO so either can be bound. The
+    // CPU copy is for culling, which would crawl through the mapping.
+    size_t n = store.size();
+    bodyStaging_.resize(n);
+    std::span<glm::vec4> mapped = bodyStream_.next<glm::vec4>(n);
+    for (size_t i = 0; i < n; ++i)
+        mapped[i] = bodyStaging_[i] =
+            glm::vec4(float(store.px[i]), float(store.py[i]),
+                      float(store.pz[i]), float(store.m[i]));
+}
 
-    glGetQueryObjectuiv(queryMeshID_, GL_QUERY_RESULT, &meshPrimitives_);
+void Renderer::drawBodiesInstanced(
+    const std::vector<std::unique_ptr<CelestialBody>> &bodies,
+    const glm::mat4 &view, const glm::mat4 &proj) {
+    if (bodies.empty())
+        return;
+    if (instances_.size() != bodies.size())
+        updateInstances(bodies);
+
+    buildMeshList(view, proj);
+    std::ranges::copy(meshList_,
+                      meshListStream_.next<GLuint>(meshList_.size()).begin());
+
+    bodyStream_.range().bind(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, instanceSSBO_.id);
+    meshListStream_.range().bind(GL_SHADER_STORAGE_BUFFER, 4);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray_.id);
+
+    if (!meshList_.empty()) {
+        glm::mat4 viewProj = proj * view;
+        instancedProg_.use();
+        glUniformMatrix4fv(instancedProg_.uniform("u_MVP"), 1, GL_FALSE,
+                           glm::value_ptr(viewProj));
+        glUniform1i(instancedProg_.uniform("u_Texture"), 0);
+        sphere_->bind();
+        sphere_->drawInstanced(static_cast<GLsizei>(meshList_.size()));
+    }
 
-    trailProg_.use();
-    glDepthMask(GL_FALSE);
-    glEnable(GL_DEPTH_TEST);
-    GLint locMvp = trailProg_.uniform("u_MVP");
-    GLint locColor = trailProg_.uniform("u_TrailColor");
+    if (!impostors_)
+        return;
+
+    // One point per body; the vertex shader drops those the mesh pass drew.
+    impostorProg_.use();
+    glUniformMatrix4fv(impostorProg_.uniform("u_View"), 1, GL_FALSE,
+                       glm::value_ptr(view));
+    glUniformMatrix4fv(impostorProg_.uniform("u_Proj"), 1, GL_FALSE,
+                       glm::value_ptr(proj));
+    glUniform1f(impostorProg_.uniform("u_ViewportHeight"), float(height_));
+    glUniform2f(impostorProg_.uniform("u_Viewport"), float(width_),
+                float(height_));
+    glUniform1f(impostorProg_.uniform("u_MeshPixels"), meshPixels_);
+    glUniform1i(impostorProg_.uniform("u_Texture"), 0);
+    glBindVertexArray(pointVAO_.id);
+    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(instances_.size()));
+}
 
-    glBeginQuery(GL_PRIMITIVES_GENERATED, queryTrailID_);
-    for (auto *b : bodies) {
-        glm::mat4 mvp = proj * view;
-        glUniformMatrix4fv(locMvp, 1, GL_FALSE, glm::value_ptr(mvp));
-        glUniform3fv(locColor, 1, glm::value_ptr(b->getTrailColor()));
-        b->drawTrail();
+void Renderer::buildMeshList(const glm::mat4 &view, const glm::mat4 &proj) {
+    meshList_.clear();
+    // Mirrors the size test in body_impostor.vert, slightly looser so a
+    // body on the threshold is drawn by both passes rather than neither.
+    constexpr float OVERLAP = 0.98f;
+    for (size_t i = 0; i < instances_.size(); ++i) {
+        const Instance &inst = instances_[i];
+        if (impostors_) {
+            glm::vec3 p{bodyStaging_[inst.body]};
+            float depth = -(view * glm::vec4(p, 1.0f)).z;
+            if (depth < -inst.scale)
+                continue; // entirely behind the camera
+            float diameter = inst.scale * proj[1][1] * height_ / depth;
+            if (depth > inst.scale && diameter < meshPixels_ * OVERLAP)
+                continue;
+        }
+        meshList_.push_back(static_cast<GLuint>(i));
     }
+}
 
-    glEndQuery(GL_PRIMITIVES_GENERATED);
+void Renderer::updateInstances(
+    const std::vector<std::unique_ptr<CelestialBody>> &bodies) {
+    bool newTexture = false;
+    instances_.resize(bodies.size());
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        const CelestialBody &b = *bodies[i];
+        auto [it, inserted] = layers_.try_emplace(
+            b.getTexturePath(), static_cast<GLuint>(layerPaths_.size()));
+        if (inserted) {
+            layerPaths_.push_back(b.getTexturePath());
+            newTexture = true;
+        }
+        instances_[i] = {b.getScale(), it->second,
+                         static_cast<GLuint>(b.getIndex()), 0};
+    }
+    if (newTexture)
+        rebuildTextureArray();
+    uploadBuffer(instanceSSBO_.id, instanceCapacity_, instances_.data(),
+                 instances_.size() * sizeof(Instance));
+}
 
-    glGetQueryObjectuiv(queryTrailID_, GL_QUERY_RESULT, &trailPrimitives_);
+void Renderer::rebuildTextureArray() {
+    // Layers already resampled are kept, so only new paths are decoded.
+    constexpr size_t LAYER_BYTES = size_t(LAYER_SIZE) * LAYER_SIZE * 4;
+    auto layers = static_cast<GLsizei>(layerPaths_.size());
+    size_t decoded = layerPixels_.size() / LAYER_BYTES;
+    layerPixels_.resize(LAYER_BYTES * layers);
+
+    for (size_t l = decoded; l < layerPaths_.size(); ++l)
+        AssetCache::resample(*AssetCache::image(layerPaths_[l]), LAYER_SIZE,
+                             layerPixels_.data() + l * LAYER_BYTES);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray_.id);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, LAYER_SIZE, LAYER_SIZE,
+                 layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, layerPixels_.data());
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+}
 
-    glDepthMask(GL_TRUE);
+void Renderer::uploadBuffer(GLuint buffer, size_t &capacity, const void *data,
+                            size_t bytes) noexcept {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    if (bytes > capacity) {
+        capacity = std::max(bytes, capacity * 2);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, capacity, nullptr,
+                     GL_DYNAMIC_DRAW);
+    }
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bytes, data);
 }
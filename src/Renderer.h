@@ -1,10 +1,16 @@
 #pragma once
 
+#include "GpuTimers.h"
 #include "GravityWell.h"
+#include "Mesh.h"
+#include "StreamBuffer.h"
+#include "TrailSystem.h"
 #include "raii.h"
 #include <filesystem>
 #include <glm/glm.hpp>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 class CelestialBody;
@@ -13,18 +19,63 @@ class Renderer {
     Renderer(int width, int height);
     ~Renderer() noexcept;
 
-    void drawAll(const std::vector<CelestialBody *> &bodies,
-                 const glm::mat4 &view, const glm::mat4 &proj) noexcept;
+    void drawAll(const std::vector<std::unique_ptr<CelestialBody>> &bodies,
+                 const ParticleStore &store, const glm::mat4 &view,
+                 const glm::mat4 &proj);
 
     void setViewportSize(int width, int height) noexcept;
 
+    // Drops trails and per-body draw data after every body was replaced,
+    // so nothing carries over from the old ones.
+    void resetBodies() noexcept {
+        trails_.clear();
+        instances_.clear();
+    }
+
+    void advanceTrails(float dt) noexcept { trails_.advance(dt); }
+    void setTrailTolerance(float pixels) noexcept {
+        trails_.setTolerance(pixels);
+    }
+    float getTrailTolerance() const noexcept { return trails_.getTolerance(); }
+
+    // Gravity-well heights from a particle-mesh potential grid rather than
+    // a per-vertex sum over every body.
+    void setWellGrid(bool on) noexcept { gravityWell_.setPotentialGrid(on); }
+    bool getWellGrid() const noexcept {
+        return gravityWell_.getPotentialGrid();
+    }
+
+    // Draw every body with one glDrawElementsInstanced, positions read from
+    // an SSBO laid out like gravity.comp's BodyData and textures from an
+    // array, instead of one draw per CelestialBody.
+    void setInstanced(bool on) noexcept { instanced_ = on; }
+    bool getInstanced() const noexcept { return instanced_; }
+
+    // With instancing on, bodies smaller than meshPixels on screen are drawn
+    // in one GL_POINTS call as ray-cast sphere impostors (or soft sprites
+    // below a couple of pixels) instead of as triangle spheres.
+    void setImpostors(bool on) noexcept { impostors_ = on; }
+    bool getImpostors() const noexcept { return impostors_; }
+    void setImpostorMeshPixels(float px) noexcept { meshPixels_ = px; }
+    float getImpostorMeshPixels() const noexcept { return meshPixels_; }
+
+    // Per-pass counts and timings arrive a few frames late; see GpuTimers.
     int getTotalPrimitives() const {
-        return meshPrimitives_ + trailPrimitives_ + wellPrimitives_;
+        return getMeshPrimitives() + getTrailPrimitives() +
+               getWellPrimitives();
     }
 
-    int getMeshPrimitives() const { return meshPrimitives_; }
-    int getTrailPrimitives() const { return trailPrimitives_; }
-    int getWellPrimitives() const { return wellPrimitives_; }
+    int getMeshPrimitives() const {
+        return int(timers_.primitives(GpuTimers::Meshes));
+    }
+    int getTrailPrimitives() const {
+        return int(timers_.primitives(GpuTimers::Trails));
+    }
+    int getWellPrimitives() const {
+        return int(timers_.primitives(GpuTimers::Well));
+    }
+    // The UI pass is recorded by the caller around its own draw.
+    GpuTimers &getGpuTimers() noexcept { return timers_; }
 
   private:
     int width_, height_;
@@ -32,15 +83,53 @@ class Renderer {
     Program bodyProg_;
     Program trailProg_;
     Program wellProg_;
+    Program instancedProg_;
+    Program impostorProg_;
     GravityWell gravityWell_;
+    TrailSystem trails_;
+
+    // Instanced body path
+    struct Instance {
+        float scale;
+        GLuint layer;
+        GLuint body; // index into the body SSBO
+        GLuint pad;
+    };
+    static constexpr int LAYER_SIZE = 512;
+    bool instanced_ = true;
+    std::shared_ptr<const Mesh> sphere_;
+    Texture2DArray textureArray_;
+    // Bodies and the mesh list change every frame; instances only when
+    // bodies are added.
+    StreamBuffer bodyStream_, meshListStream_;
+    Buffer instanceSSBO_;
+    size_t instanceCapacity_ = 0;
+    std::vector<glm::vec4> bodyStaging_;
+    std::vector<Instance> instances_;
+    std::vector<GLuint> meshList_;
+    std::unordered_map<std::string, GLuint> layers_;
+    std::vector<std::string> layerPaths_;
+    std::vector<unsigned char> layerPixels_; // resampled, one per path
+
+    // Impostor path
+    bool impostors_ = true;
+    float meshPixels_ = 24.0f;
+    VertexArray pointVAO_; // attribute-less; core profile needs one bound
 
-    GLuint queryMeshID_ = 0;
-    GLuint queryTrailID_ = 0;
-    GLuint queryWellID_ = 0;
+    GpuTimers timers_;
 
-    GLuint meshPrimitives_ = 0;
-    GLuint trailPrimitives_ = 0;
-    GLuint wellPrimitives_ = 0;
+    void uploadBodies(const ParticleStore &store);
+    void drawBodies(const std::vector<std::unique_ptr<CelestialBody>> &bodies,
+                    const glm::mat4 &view, const glm::mat4 &proj) noexcept;
+    void drawBodiesInstanced(
+        const std::vector<std::unique_ptr<CelestialBody>> &bodies,
+        const glm::mat4 &view, const glm::mat4 &proj);
+    void buildMeshList(const glm::mat4 &view, const glm::mat4 &proj);
+    void updateInstances(
+        const std::vector<std::unique_ptr<CelestialBody>> &bodies);
+    void rebuildTextureArray();
 
+    static void uploadBuffer(GLuint buffer, size_t &capacity,
+                             const void *data, size_t bytes) noexcept;
     static std::string loadFile(const std::filesystem::path &path);
 };
@@ -0,0 +1,46 @@
+#include "Scenarios.h"
+
+#include <cmath>
+#include <random>
+
+namespace Scenarios {
+std::vector<BodyInit> figureEight() {
+    constexpr double posScale = 20.0;
+    constexpr double G_factor = 0.5;
+    constexpr double mass = 100.0;
+    double GM_over_L = (G_factor * mass) / posScale;
+    double vScale = std::sqrt(GM_over_L);
+
+    glm::dvec2 r1_orig = {-0.602885898116520, 0.059162128863347};
+    glm::dvec2 r2_orig = {0.252709795391000, 0.058254872224370};
+    glm::dvec2 r3_orig = {-0.355389016941814, 0.038323764315145};
+    glm::dvec2 v1_orig = {0.122913546623784, 0.747443868604908};
+    glm::dvec2 v2_orig = {-0.019325586404545, 1.369241993562101};
+    glm::dvec2 v3_orig = {-0.103587960218793, -2.116685862168820};
+
+    return {
+        {mass, glm::dvec3(r1_orig.x, 0.0, r1_orig.y) * posScale,
+         glm::dvec3(v1_orig.x, 0.0, v1_orig.y) * vScale},
+        {mass, glm::dvec3(r2_orig.x, 0.0, r2_orig.y) * posScale,
+         glm::dvec3(v2_orig.x, 0.0, v2_orig.y) * vScale},
+        {mass, glm::dvec3(r3_orig.x, 0.0, r3_orig.y) * posScale,
+         glm::dvec3(v3_orig.x, 0.0, v3_orig.y) * vScale},
+    };
+}
+
+std::vector<BodyInit> randomCube(int n, double mass, double space,
+                                 unsigned seed) {
+    std::default_random_engine rng{seed};
+    std::uniform_real_distribution<double> posDist(-space, space);
+    std::uniform_real_distribution<double> velDist(-1.0, 1.0);
+
+    std::vector<BodyInit> bodies;
+    bodies.reserve(n);
+    for (int i = 0; i < n; ++i) {
+        glm::dvec3 pos(posDist(rng), posDist(rng), posDist(rng));
+        glm::dvec3 vel(velDist(rng), velDist(rng), velDist(rng));
+        bodies.push_back({mass, pos, vel});
+    }
+    return bodies;
+}
+} // namespace Scenarios
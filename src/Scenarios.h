@@ -0,0 +1,22 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// Initial conditions shared by the interactive scene and the headless
+// driver.
+namespace Scenarios {
+struct BodyInit {
+    double mass;
+    glm::dvec3 position;
+    glm::dvec3 velocity;
+};
+
+// Chenciner–Montgomery figure-eight three-body orbit, scaled to G = 0.5.
+std::vector<BodyInit> figureEight();
+
+// n equal masses with uniform positions in [-space, space]^3 and velocity
+// components in [-1, 1].
+std::vector<BodyInit> randomCube(int n, double mass = 100.0,
+                                 double space = 50.0, unsigned seed = 0);
+} // namespace Scenarios
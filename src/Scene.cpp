@@ -1,25 +1,34 @@
 #include "Scene.h"
+#include "AllocationCounter.h"
+#include "AssetCache.h"
 #include "CelestialBody.h"
+#include "Profiler.h"
+#include "Scenarios.h"
 #include <glm/gtc/matrix_transform.hpp>
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdio>
 #include <random>
 
+// A region is only rewritten once the frame that used it has retired.
+static_assert(StreamBuffer::REGIONS > FramePacer::MAX_FRAMES_IN_FLIGHT);
+
 Scene::Scene(int width, int height)
     : width(width), height(height), renderer(width, height) {}
 
 Scene::~Scene() {
+    physicsThread.stop();
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
-
-    if (window)
-        glfwDestroyWindow(window);
-    glfwTerminate();
 }
 
-void Scene::initialize(GLFWwindow *win) {
+void Scene::initialize(GLFWwindow *win, GLFWwindow *physicsContext) {
     window = win;
     glfwSetWindowUserPointer(window, &renderer);
 
@@ -29,74 +38,182 @@ void Scene::initialize(GLFWwindow *win) {
     ImGui_ImplOpenGL3_Init("#version 450");
 
     addInitialBodies();
+
+    settings_.backend = physics.getBackend();
+    settings_.integrator = physics.getIntegrator();
+    settings_.gpuResident = physics.getGpuResident();
+    settings_.tiledKernel = physics.getTiledKernel();
+    settings_.blockTimesteps = physics.getBlockTimesteps();
+
+    // From here on the engine belongs to the physics thread; settings and
+    // new bodies reach it through post().
+    physicsThread.start(physicsContext);
+}
+
+void Scene::addBody(double mass, const glm::dvec3 &pos, const glm::dvec3 &vel,
+                    float scale, const char *texturePath,
+                    const glm::vec3 &trailColor) {
+    if (physicsThread.running())
+        physicsThread.post([=](PhysicsEngine &engine) {
+            engine.addBody(mass, pos, vel);
+        });
+    else
+        physics.addBody(mass, pos, vel);
+
+    // Appended in the same order on both sides, so the indices agree.
+    size_t index = renderState.add(mass, pos, vel);
+    bodies.push_back(std::make_unique<CelestialBody>(
+        renderState, index, scale, texturePath, trailColor));
 }
 
 void Scene::addInitialBodies() {
-    constexpr double posScale = 20.0;
-    constexpr double G_factor = 0.5;
-    constexpr double mass = 100.0;
-    double GM_over_L = (G_factor * mass) / posScale;
-    double vScale = std::sqrt(GM_over_L);
-
-    glm::dvec2 r1_orig = {-0.602885898116520, 0.059162128863347};
-    glm::dvec2 r2_orig = {0.252709795391000, 0.058254872224370};
-    glm::dvec2 r3_orig = {-0.355389016941814, 0.038323764315145};
-    glm::dvec2 v1_orig = {0.122913546623784, 0.747443868604908};
-    glm::dvec2 v2_orig = {-0.019325586404545, 1.369241993562101};
-    glm::dvec2 v3_orig = {-0.103587960218793, -2.116685862168820};
-
-    auto body1 = std::make_unique<CelestialBody>(
-        mass, glm::dvec3(r1_orig.x, 0.0, r1_orig.y) * posScale,
-        glm::dvec3(v1_orig.x, 0.0, v1_orig.y) * vScale, 0.5f,
-        "textures/dirt.jpg", glm::vec3(1.0f, 0.0f, 0.0f));
-
-    auto body2 = std::make_unique<CelestialBody>(
-        mass, glm::dvec3(r2_orig.x, 0.0, r2_orig.y) * posScale,
-        glm::dvec3(v2_orig.x, 0.0, v2_orig.y) * vScale, 0.5f,
-        "textures/lava.png", glm::vec3(0.0f, 1.0f, 0.0f));
-
-    auto body3 = std::make_unique<CelestialBody>(
-        mass, glm::dvec3(r3_orig.x, 0.0, r3_orig.y) * posScale,
-        glm::dvec3(v3_orig.x, 0.0, v3_orig.y) * vScale, 0.5f,
-        "textures/stone.jpg", glm::vec3(0.0f, 0.4f, 1.0f));
-
-    physics.addBody(std::move(body1));
-    physics.addBody(std::move(body2));
-    physics.addBody(std::move(body3));
+    static const char *textures[] = {"textures/dirt.jpg", "textures/lava.png",
+                                     "textures/stone.jpg"};
+    static const glm::vec3 colors[] = {{1.0f, 0.0f, 0.0f},
+                                       {0.0f, 1.0f, 0.0f},
+                                       {0.0f, 0.4f, 1.0f}};
+
+    auto bodies = Scenarios::figureEight();
+    for (size_t i = 0; i < bodies.size(); ++i)
+        addBody(bodies[i].mass, bodies[i].position, bodies[i].velocity, 0.5f,
+                textures[i], colors[i]);
 }
 
 void Scene::addRandomBodies(int n, double mass, double space) {
     std::default_random_engine rng{std::random_device{}()};
-    std::uniform_real_distribution<double> posDist(-space, space);
-    std::uniform_real_distribution<double> velDist(-1.0, 1.0);
     std::uniform_real_distribution<float> colorDist(0.2f, 1.0f);
 
+    auto bodies = Scenarios::randomCube(n, mass, space, rng());
     for (int i = 0; i < n; ++i) {
-        glm::dvec3 pos(posDist(rng), posDist(rng), posDist(rng));
-        glm::dvec3 vel(velDist(rng), velDist(rng), velDist(rng));
         glm::vec3 color(colorDist(rng), colorDist(rng), colorDist(rng));
 
         std::string tex = (i % 3 == 0)   ? "textures/dirt.jpg"
                           : (i % 3 == 1) ? "textures/lava.png"
                                          : "textures/stone.jpg";
 
-        auto body = std::make_unique<CelestialBody>(mass, pos, vel, 0.5f,
-                                                    tex.c_str(), color);
-        physics.addBody(std::move(body));
+        addBody(mass, bodies[i].position, bodies[i].velocity, 0.5f,
+                tex.c_str(), color);
     }
 }
 
-void Scene::update(float deltaTime) {
-    constexpr double maxSubstep = 0.01;
-    double remaining = deltaTime;
-    while (remaining > 0.0) {
-        double step = std::min(remaining, maxSubstep);
-        physics.step(step);
-        remaining -= step;
+void Scene::loadCheckpoint() {
+    auto store = std::make_shared<ParticleStore>();
+    Checkpoint::Settings loaded;
+    auto begin = std::chrono::steady_clock::now();
+    try {
+        loaded = Checkpoint::load(CHECKPOINT_PATH, *store);
+    } catch (const std::exception &e) {
+        checkpointStatus_ = e.what();
+        return;
+    }
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - begin)
+                    .count();
+
+    // Checkpoints don't keep looks; dress the bodies like random ones.
+    static const char *textures[] = {"textures/dirt.jpg", "textures/lava.png",
+                                     "textures/stone.jpg"};
+    std::default_random_engine rng{std::random_device{}()};
+    std::uniform_real_distribution<float> colorDist(0.2f, 1.0f);
+    renderState = *store;
+    bodies.clear();
+    for (size_t i = 0; i < renderState.size(); ++i) {
+        glm::vec3 color(colorDist(rng), colorDist(rng), colorDist(rng));
+        bodies.push_back(std::make_unique<CelestialBody>(
+            renderState, i, 0.5f, textures[i % 3], color));
     }
+    renderer.resetBodies();
+
+    physicsThread.restore(std::move(store), loaded);
+    ++restores_;
+
+    settings_.backend = loaded.backend;
+    settings_.integrator = loaded.integrator;
+    settings_.theta = float(loaded.theta);
+    settings_.quadrupole = loaded.quadrupole;
+    settings_.meshGrid = loaded.meshGrid;
+    settings_.meshTsc = loaded.assignment == MassAssignment::TSC;
+    settings_.meshShortRange = loaded.meshShortRange;
+    settings_.gpuResident = loaded.gpuResident;
+    settings_.tiledKernel = loaded.tiledKernel;
+    settings_.blockTimesteps = loaded.blockTimesteps;
+
+    char buf[128];
+    std::snprintf(buf, sizeof(buf), "Loaded %zu bodies at t = %.2f (%.1f ms)",
+                  renderState.size(), loaded.time, ms);
+    checkpointStatus_ = buf;
+}
+
+void Scene::startRecording() {
+    // The previous file must be complete before its path is reopened: the
+    // physics thread lets go of the recorder between steps, then its writer
+    // is joined. Until the recorder is back, try again next frame rather
+    // than block the render thread on the physics thread.
+    startPending_ = true;
+    if (recorderReturned_.valid()) {
+        if (recorderReturned_.wait_for(std::chrono::seconds(0)) !=
+            std::future_status::ready)
+            return;
+        recorderReturned_.get();
+    }
+    startPending_ = false;
+    if (recorder_)
+        recorder_->close();
+    recorder_.reset();
+    try {
+        recorder_ = std::make_shared<Trajectory::Recorder>(
+            TRAJECTORY_PATH, Trajectory::Options{});
+    } catch (const std::exception &e) {
+        recordStatus_ = e.what();
+        recording_ = false;
+        return;
+    }
+    recordStatus_.clear();
+    physicsThread.record(recorder_);
+}
+
+void Scene::interpolateSnapshot() {
+    physicsThread.acquire();
+    const PhysicsSnapshot &snap = physicsThread.latest();
+    // Positions of bodies a loaded checkpoint has already replaced.
+    if (snap.restores != restores_)
+        return;
+
+    // Show the state between the last two publishes, advancing with wall
+    // time since the newest one arrived.
+    double alpha = 1.0;
+    double span = snap.time - snap.prevTime;
+    if (span > 0.0) {
+        double elapsed = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - snap.publishedAt)
+                             .count();
+        alpha = std::clamp(elapsed / span, 0.0, 1.0);
+    }
+
+    size_t n = std::min(snap.curr.size(), renderState.size());
+    for (size_t i = 0; i < n; ++i) {
+        renderState.setPosition(i, glm::mix(snap.prev[i], snap.curr[i], alpha));
+        renderState.m[i] = snap.mass[i];
+    }
+}
+
+void Scene::update(float deltaTime) {
+    PROFILE_ZONE("Scene::update");
+    pacer.beginFrame();
+    if (physicsThread.running())
+        interpolateSnapshot();
+
+    renderer.advanceTrails(deltaTime);
 }
 
 void Scene::render(float dt) {
+    PROFILE_ZONE("Scene::render");
+    // Heap allocations made by every thread since the last frame; a steady
+    // frame should make none.
+    uint64_t allocations = AllocationCounter::total();
+    frameAllocations_ = allocations - lastAllocations_;
+    lastAllocations_ = allocations;
+
     int w, h;
     glfwGetFramebufferSize(window, &w, &h);
 
@@ -107,22 +224,266 @@ void Scene::render(float dt) {
         glm::perspective(glm::radians(45.0f), aspect, 0.1f, 5000.0f);
     glm::mat4 view = camera.getViewMatrix();
 
-    renderer.drawAll(physics.getBodies(), view, proj);
+    renderer.drawAll(bodies, renderState, view, proj);
+    // The GPU draws the scene while the UI is built.
+    glFlush();
 
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
 
-    ImGui::SetNextWindowSize(ImVec2(200, 200), ImGuiCond_Always);
+    // Zero height fits the window to its contents as sections open.
+    ImGui::SetNextWindowSize(ImVec2(240, 0), ImGuiCond_Always);
 
     ImGui::Begin("Performance");
     ImGui::Text("FPS: %.1f", 1.0f / dt);
     ImGui::Text("Frame time: %.2f ms", dt * 1000.0f);
+    ImGui::Text("GPU wait: %.2f ms", pacer.waitMs());
     ImGui::Text("Primitives: %d", renderer.getTotalPrimitives());
+    ImGui::Text("Assets: %zu meshes, %zu textures", AssetCache::liveMeshes(),
+                AssetCache::liveTextures());
+    if (AllocationCounter::enabled())
+        ImGui::Text("Allocations/frame: %llu",
+                    static_cast<unsigned long long>(frameAllocations_));
+    else
+        ImGui::TextUnformatted("Allocations/frame: n/a");
+    bool instanced = renderer.getInstanced();
+    if (ImGui::Checkbox("Instanced bodies", &instanced))
+        renderer.setInstanced(instanced);
+    float tolerance = renderer.getTrailTolerance();
+    if (ImGui::SliderFloat("Trail tolerance px", &tolerance, 0.1f, 8.0f))
+        renderer.setTrailTolerance(tolerance);
+    bool wellGrid = renderer.getWellGrid();
+    if (ImGui::Checkbox("Well from PM grid", &wellGrid))
+        renderer.setWellGrid(wellGrid);
+    if (instanced) {
+        bool impostors = renderer.getImpostors();
+        if (ImGui::Checkbox("Impostors", &impostors))
+            renderer.setImpostors(impostors);
+        float meshPixels = renderer.getImpostorMeshPixels();
+        if (impostors &&
+            ImGui::SliderFloat("Mesh above px", &meshPixels, 2.0f, 256.0f))
+            renderer.setImpostorMeshPixels(meshPixels);
+    }
+    if (ImGui::CollapsingHeader("GPU passes"))
+        drawGpuPasses();
+    if (ImGui::CollapsingHeader("CPU zones"))
+        drawCpuZones();
     ImGui::End();
 
+    drawPhysicsPanel();
+
     ImGui::Render();
+    PROFILE_ZONE("ImGui draw");
+    GpuTimers &timers = renderer.getGpuTimers();
+    timers.begin(GpuTimers::Ui);
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    timers.end(GpuTimers::Ui);
+    pacer.endFrame();
+}
+
+void Scene::drawGpuPasses() {
+    const GpuTimers &timers = renderer.getGpuTimers();
+    float total = 0.0f;
+    for (int p = 0; p < GpuTimers::RENDER_PASSES; ++p) {
+        auto pass = static_cast<GpuTimers::Pass>(p);
+        total += timers.averageMs(pass);
+        char label[64];
+        std::snprintf(label, sizeof(label), "%s %.2f ms",
+                      GpuTimers::name(pass), timers.averageMs(pass));
+        ImGui::PushID(p);
+        ImGui::PlotHistogram("##pass", timers.history(pass), GpuTimers::HISTORY,
+                             timers.historyOffset(pass), label, 0.0f,
+                             std::max(1.0f, 2.0f * timers.averageMs(pass)),
+                             ImVec2(0, 32));
+        ImGui::PopID();
+    }
+    ImGui::Text("GPU total: %.2f ms (%d frames late)", total,
+                GpuTimers::FRAMES);
+
+    // Timed on the physics thread, so not part of the frame total.
+    const PhysicsSnapshot &snap = physicsThread.latest();
+    ImGui::Separator();
+    ImGui::Text("Physics %s: %.3f ms per dispatch",
+                GpuTimers::name(GpuTimers::Gravity), snap.gravityGpuMs);
+    ImGui::Text("Physics %s: %.3f ms", GpuTimers::name(GpuTimers::Resident),
+                snap.residentGpuMs);
+}
+
+void Scene::drawCpuZones() {
+    bool enabled = Profiler::enabled();
+    if (ImGui::Checkbox("Record", &enabled))
+        Profiler::setEnabled(enabled);
+    ImGui::SameLine();
+    if (ImGui::Button("Save trace")) {
+        try {
+            size_t zones = Profiler::writeChromeTrace(TRACE_PATH);
+            traceStatus_ = std::to_string(zones) + " zones -> " + TRACE_PATH;
+        } catch (const std::exception &e) {
+            traceStatus_ = e.what();
+        }
+    }
+    if (!traceStatus_.empty())
+        ImGui::TextUnformatted(traceStatus_.c_str());
+
+    // Last frame's zones, indented by nesting, per thread.
+    Profiler::lastFrame(zones_);
+    const char *thread = nullptr;
+    for (const Profiler::ZoneTotal &z : zones_) {
+        if (z.thread != thread) {
+            thread = z.thread;
+            ImGui::Separator();
+            ImGui::TextUnformatted(thread);
+        }
+        ImGui::Text("%*s%s", int(2 * z.depth), "", z.name);
+        ImGui::SameLine(ImGui::GetWindowWidth() - 90.0f);
+        if (z.calls > 1)
+            ImGui::Text("%6.2f ms x%u", z.ms, z.calls);
+        else
+            ImGui::Text("%6.2f ms", z.ms);
+    }
+}
+
+void Scene::drawPhysicsPanel() {
+    static const char *backends[] = {"GPU direct sum", "CPU direct sum",
+                                     "Barnes-Hut", "Particle mesh"};
+    const PhysicsSnapshot &snap = physicsThread.latest();
+    PhysicsSettings &ui = settings_;
+
+    ImGui::SetNextWindowPos(ImVec2(10, 220), ImGuiCond_FirstUseEver);
+    ImGui::Begin("Physics");
+    ImGui::Text("Sim time: %.2f  steps: %llu", snap.time,
+                static_cast<unsigned long long>(snap.steps));
+    ImGui::Text("Step: %.3f ms (dt %.3f)", snap.stepMs,
+                physicsThread.fixedDt());
+
+    int backend = static_cast<int>(ui.backend);
+    if (ImGui::Combo("Backend", &backend, backends, IM_ARRAYSIZE(backends))) {
+        ui.backend = static_cast<ForceBackend>(backend);
+        physicsThread.post(
+            [b = ui.backend](PhysicsEngine &e) { e.setBackend(b); });
+    }
+
+    const Integrators::Info &scheme = Integrators::info(ui.integrator);
+    if (ImGui::BeginCombo("Integrator", scheme.name)) {
+        for (size_t i = 0; i < Integrators::TABLE.size(); ++i) {
+            auto integrator = static_cast<Integrator>(i);
+            if (ImGui::Selectable(Integrators::TABLE[i].name,
+                                  integrator == ui.integrator)) {
+                ui.integrator = integrator;
+                physicsThread.post([integrator](PhysicsEngine &e) {
+                    e.setIntegrator(integrator);
+                });
+            }
+        }
+        ImGui::EndCombo();
+    }
+    ImGui::Text("Order %d, %zu force evals/step", scheme.order,
+                scheme.kick.size());
+
+    if (ui.backend == ForceBackend::BarnesHut) {
+        if (ImGui::SliderFloat("Theta", &ui.theta, 0.1f, 1.2f))
+            physicsThread.post([t = ui.theta](PhysicsEngine &e) {
+                e.getBarnesHut().setTheta(t);
+            });
+        if (ImGui::Checkbox("Quadrupole", &ui.quadrupole))
+            physicsThread.post([q = ui.quadrupole](PhysicsEngine &e) {
+                e.getBarnesHut().setQuadrupole(q);
+            });
+        ImGui::Text("Nodes: %zu", snap.treeNodes);
+    } else if (ui.backend == ForceBackend::GpuDirect) {
+        if (ImGui::Checkbox("GPU-resident step", &ui.gpuResident))
+            physicsThread.post([r = ui.gpuResident](PhysicsEngine &e) {
+                e.setGpuResident(r);
+            });
+        if (ImGui::Checkbox("Tiled kernel", &ui.tiledKernel))
+            physicsThread.post([t = ui.tiledKernel](PhysicsEngine &e) {
+                e.setTiledKernel(t);
+            });
+        if (ui.tiledKernel)
+            ImGui::Text("Workgroup %d, tile %d, unroll %d",
+                        snap.kernel.workgroupSize, snap.kernel.tileSize,
+                        snap.kernel.unroll);
+    } else if (ui.backend == ForceBackend::CpuDirect) {
+        ImGui::Text("Kernel: %s", DirectSum::isaName());
+    } else if (ui.backend == ForceBackend::ParticleMesh) {
+        int log2Grid = std::countr_zero(unsigned(ui.meshGrid));
+        if (ImGui::SliderInt("Grid", &log2Grid, 4, 7, "")) {
+            ui.meshGrid = 1 << log2Grid;
+            physicsThread.post([g = ui.meshGrid](PhysicsEngine &e) {
+                e.getParticleMesh().setGridSize(g);
+            });
+        }
+        ImGui::SameLine();
+        ImGui::Text("%d^3", ui.meshGrid);
+        if (ImGui::Checkbox("TSC assignment", &ui.meshTsc))
+            physicsThread.post([t = ui.meshTsc](PhysicsEngine &e) {
+                e.getParticleMesh().setAssignment(t ? MassAssignment::TSC
+                                                    : MassAssignment::CIC);
+            });
+        if (ImGui::Checkbox("P3M short range", &ui.meshShortRange))
+            physicsThread.post([s = ui.meshShortRange](PhysicsEngine &e) {
+                e.getParticleMesh().setShortRange(s);
+            });
+    }
+
+    bool resident = ui.backend == ForceBackend::GpuDirect && ui.gpuResident;
+    if (!resident) {
+        if (ImGui::Checkbox("Block timesteps", &ui.blockTimesteps))
+            physicsThread.post([b = ui.blockTimesteps](PhysicsEngine &e) {
+                e.setBlockTimesteps(b);
+            });
+        if (ui.blockTimesteps)
+            ImGui::Text("Deepest level: %d (dt / %d)", snap.deepestLevel,
+                        1 << snap.deepestLevel);
+    }
+    ImGui::Text("Force evals/step: %.0f", snap.evalsPerStep);
+
+    if (ImGui::Button("Validate GPU vs CPU"))
+        physicsThread.post([this](PhysicsEngine &e) {
+            validationError_ = e.compareBackends(ForceBackend::CpuDirect,
+                                                 ForceBackend::GpuDirect);
+        });
+    if (double err = validationError_.load(); err >= 0.0)
+        ImGui::Text("Max rel. error: %.2e", err);
+
+    if (ImGui::Button("Save checkpoint"))
+        physicsThread.saveCheckpoint(CHECKPOINT_PATH, checkpointWriter_);
+    ImGui::SameLine();
+    if (ImGui::Button("Load"))
+        loadCheckpoint();
+    checkpointWriter_.status(writerStatus_);
+    if (checkpointWriter_.busy())
+        ImGui::TextUnformatted("Writing checkpoint...");
+    else if (!writerStatus_.empty())
+        ImGui::TextUnformatted(writerStatus_.c_str());
+    if (!checkpointStatus_.empty())
+        ImGui::TextUnformatted(checkpointStatus_.c_str());
+
+    if (ImGui::Checkbox("Record trajectory", &recording_)) {
+        if (recording_)
+            startRecording();
+        else if (startPending_)
+            startPending_ = false; // never started, nothing to stop
+        else
+            recorderReturned_ = physicsThread.stopRecording();
+    } else if (startPending_) {
+        startRecording();
+    }
+    if (startPending_) {
+        ImGui::TextUnformatted("Finishing the last recording...");
+    } else if (recorder_) {
+        Trajectory::Recorder::Stats t = recorder_->stats();
+        ImGui::Text("%llu frames, %.1f MB, %llu dropped",
+                    static_cast<unsigned long long>(t.written),
+                    double(t.bytes) / 1e6,
+                    static_cast<unsigned long long>(t.dropped));
+        if (t.failed)
+            ImGui::Text("Cannot write %s", TRAJECTORY_PATH);
+    }
+    if (!recordStatus_.empty())
+        ImGui::TextUnformatted(recordStatus_.c_str());
+    ImGui::End();
 }
 
 Camera &Scene::getCamera() { return camera; }
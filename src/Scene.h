@@ -1,17 +1,29 @@
 #pragma once
 
 #include "Camera.h"
+#include "CelestialBody.h"
+#include "Checkpoint.h"
+#include "FramePacer.h"
 #include "PhysicsEngine.h"
+#include "PhysicsThread.h"
+#include "Profiler.h"
 #include "Renderer.h"
+#include "Trajectory.h"
 
 #include <GLFW/glfw3.h>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
 
 class Scene {
   public:
     Scene(int width, int height);
     ~Scene();
 
-    void initialize(GLFWwindow *window);
+    // physicsContext is a hidden window sharing objects with `window`; it
+    // becomes current on the physics thread for the GPU backends.
+    void initialize(GLFWwindow *window, GLFWwindow *physicsContext);
     void update(float deltaTime);
     void render(float dt);
 
@@ -24,8 +36,62 @@ class Scene {
 
     Camera camera;
     PhysicsEngine physics;
+    PhysicsThread physicsThread{physics};
     Renderer renderer;
+    FramePacer pacer;
 
+    // Interpolated copy of the latest physics snapshots; bodies index into
+    // this rather than the engine's store, which the physics thread owns.
+    ParticleStore renderState;
+    std::vector<std::unique_ptr<CelestialBody>> bodies;
+
+    // UI-side mirror of engine settings, applied through physicsThread.post.
+    struct PhysicsSettings {
+        ForceBackend backend = ForceBackend::GpuDirect;
+        Integrator integrator = Integrator::Yoshida4;
+        float theta = 0.5f;
+        bool quadrupole = true;
+        int meshGrid = 32;
+        bool meshTsc = true;
+        bool meshShortRange = false;
+        bool gpuResident = false;
+        bool tiledKernel = true;
+        bool blockTimesteps = false;
+    } settings_;
+    std::atomic<double> validationError_{-1.0};
+
+    static constexpr const char *TRACE_PATH = "spacetime_trace.json";
+    std::vector<Profiler::ZoneTotal> zones_;
+    std::string traceStatus_;
+    // AllocationCounter::total() at the previous frame, and the difference.
+    uint64_t lastAllocations_ = 0;
+    uint64_t frameAllocations_ = 0;
+
+    static constexpr const char *CHECKPOINT_PATH = "spacetime.ckpt";
+    Checkpoint::Writer checkpointWriter_;
+    std::string writerStatus_, checkpointStatus_;
+    // Checkpoints loaded; snapshots from before the latest are skipped.
+    uint64_t restores_ = 0;
+
+    static constexpr const char *TRAJECTORY_PATH = "spacetime.traj";
+    // The current or last recording, shared with the physics thread until
+    // it hands the recorder back after stopRecording().
+    std::shared_ptr<Trajectory::Recorder> recorder_;
+    std::future<std::shared_ptr<Trajectory::Recorder>> recorderReturned_;
+    bool recording_ = false;
+    // Ticked before the last recorder came back; retried every frame.
+    bool startPending_ = false;
+    std::string recordStatus_;
+
+    void addBody(double mass, const glm::dvec3 &pos, const glm::dvec3 &vel,
+                 float scale, const char *texturePath,
+                 const glm::vec3 &trailColor);
     void addInitialBodies();
+    void loadCheckpoint();
+    void startRecording();
+    void interpolateSnapshot();
+    void drawPhysicsPanel();
+    void drawGpuPasses();
+    void drawCpuZones();
     void addRandomBodies(int n = 100, double mass = 100.0, double space = 50.0);
 };
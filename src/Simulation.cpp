@@ -1,4 +1,5 @@
 #include "Simulation.h"
+#include "Profiler.h"
 #include "Scene.h"
 
 #include <glad/glad.h>
@@ -9,11 +10,13 @@
 
 Simulation::Simulation(int width, int height)
     : windowWidth(width), windowHeight(height) {
+    Profiler::setThreadName("render");
+    Profiler::setEnabled(true);
     initGLFW();
     initGLAD();
 
     scene = std::make_unique<Scene>(windowWidth, windowHeight);
-    scene->initialize(window);
+    scene->initialize(window, physicsContext);
 
     glfwSetWindowUserPointer(window, this);
     glfwSetFramebufferSizeCallback(window, framebufferSizeCallbackWrapper);
@@ -36,6 +39,12 @@ void Simulation::initGLFW() {
     if (!window)
         throw std::runtime_error("GLFW window creation failed");
 
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    physicsContext = glfwCreateWindow(1, 1, "", nullptr, window);
+    glfwDefaultWindowHints();
+    if (!physicsContext)
+        throw std::runtime_error("GLFW physics context creation failed");
+
     glfwMakeContextCurrent(window);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 }
@@ -54,6 +63,12 @@ void Simulation::initGLAD() {
 }
 
 void Simulation::shutdown() {
+    // The scene joins the physics thread, which still has physicsContext
+    // current, and needs the GL context for its own teardown.
+    scene.reset();
+
+    if (physicsContext)
+        glfwDestroyWindow(physicsContext);
     if (window)
         glfwDestroyWindow(window);
     glfwTerminate();
@@ -61,6 +76,8 @@ void Simulation::shutdown() {
 
 void Simulation::run() {
     while (!glfwWindowShouldClose(window)) {
+        Profiler::markFrame();
+        PROFILE_ZONE("Frame");
         double now = glfwGetTime();
         lastDeltaTime = now - lastTime;
         lastTime = now;
@@ -69,13 +86,26 @@ void Simulation::run() {
         scene->update(static_cast<float>(lastDeltaTime));
         render();
 
-        glfwSwapBuffers(window);
+        {
+            PROFILE_ZONE("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
     }
 }
 
 void Simulation::handleInput(float deltaTime) {
-    scene->getCamera().updateFromInput(window, deltaTime);
+    bool tabDown = glfwGetKey(window, GLFW_KEY_TAB) == GLFW_PRESS;
+    if (tabDown && !tabWasDown) {
+        uiMode = !uiMode;
+        glfwSetInputMode(window, GLFW_CURSOR,
+                         uiMode ? GLFW_CURSOR_NORMAL : GLFW_CURSOR_DISABLED);
+        scene->getCamera().resetMouse();
+    }
+    tabWasDown = tabDown;
+
+    if (!uiMode)
+        scene->getCamera().updateFromInput(window, deltaTime);
 
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
@@ -24,8 +24,13 @@ class Simulation {
     static void framebufferSizeCallbackWrapper(GLFWwindow *, int, int);
 
     GLFWwindow *window = nullptr;
+    // Hidden window whose context shares objects with `window`; the physics
+    // thread makes it current.
+    GLFWwindow *physicsContext = nullptr;
     int windowWidth, windowHeight;
     double lastTime = 0.0;
     double lastDeltaTime = 0.0;
+    bool uiMode = false;
+    bool tabWasDown = false;
     std::unique_ptr<Scene> scene;
 };
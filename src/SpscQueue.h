@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Bounded single-producer / single-consumer queue of reusable slots. The
+// producer fills the slot returned by write() and push()es it; the consumer
+// takes slots from wait() and pop()s them. Slots keep their contents, so
+// buffers inside T are reused once grown. The producer never blocks:
+// write() returns nullptr while the queue is full.
+template <class T, size_t Capacity> class SpscQueue {
+  public:
+    // Producer side.
+    T *write() noexcept {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) == Capacity)
+            return nullptr;
+        return &slots_[head % Capacity];
+    }
+    void push() noexcept {
+        head_.store(head_.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_release);
+        signal();
+    }
+    // No more pushes; wait() returns nullptr once the rest is consumed.
+    void close() noexcept {
+        closed_.store(true, std::memory_order_release);
+        signal();
+    }
+
+    // Consumer side. Blocks until a slot is readable.
+    T *wait() noexcept {
+        for (;;) {
+            uint32_t seen = signal_.load(std::memory_order_acquire);
+            size_t tail = tail_.load(std::memory_order_relaxed);
+            if (tail != head_.load(std::memory_order_acquire))
+                return &slots_[tail % Capacity];
+            if (closed_.load(std::memory_order_acquire))
+                return nullptr;
+            signal_.wait(seen, std::memory_order_acquire);
+        }
+    }
+    void pop() noexcept {
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_release);
+    }
+
+  private:
+    std::array<T, Capacity> slots_{};
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    // Bumped on every push and close so a sleeping consumer wakes.
+    alignas(64) std::atomic<uint32_t> signal_{0};
+    std::atomic<bool> closed_{false};
+
+    void signal() noexcept {
+        signal_.fetch_add(1, std::memory_order_release);
+        signal_.notify_one();
+    }
+};
@@ -0,0 +1,69 @@
+#include "StreamBuffer.h"
+#include "raii.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+StreamBuffer::~StreamBuffer() noexcept { release(); }
+
+void StreamBuffer::release() noexcept {
+    for (GLsync &sync : fences_)
+        if (sync) {
+            glDeleteSync(sync);
+            sync = nullptr;
+        }
+    // Deleting unmaps; the driver keeps the storage alive for commands
+    // still in flight.
+    if (buffer_)
+        glDeleteBuffers(1, &buffer_);
+    buffer_ = 0;
+    mapped_ = nullptr;
+}
+
+void StreamBuffer::allocate(size_t bytes) {
+    GLint align = 256;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &align);
+    size_t region = std::max(bytes, 2 * regionBytes_);
+    region = (std::max<size_t>(region, 1) + align - 1) / align * align;
+
+    release();
+    GLbitfield access =
+        GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT |
+        (direction_ == Upload ? GL_MAP_WRITE_BIT : GL_MAP_READ_BIT);
+    // Readback storage is better off in cached system memory.
+    GLbitfield storage =
+        access | (direction_ == Readback ? GL_CLIENT_STORAGE_BIT : 0);
+    glGenBuffers(1, &buffer_);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, REGIONS * region, nullptr, storage);
+    mapped_ = static_cast<std::byte *>(
+        glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, REGIONS * region, access));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    if (!mapped_) {
+        release();
+        throw std::runtime_error("cannot map a stream buffer");
+    }
+    regionBytes_ = region;
+}
+
+void *StreamBuffer::next(size_t bytes) {
+    if (!buffer_ || bytes > regionBytes_)
+        allocate(bytes);
+    region_ = (region_ + 1) % REGIONS;
+    waitAndDeleteSync(fences_[region_]);
+    bytes_ = bytes;
+    return mapped_ + region_ * regionBytes_;
+}
+
+void StreamBuffer::fence() noexcept {
+    if (!buffer_)
+        return;
+    // Shader writes are incoherent; make them reach the mapping first.
+    if (direction_ == Readback)
+        glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+    if (fences_[region_])
+        glDeleteSync(fences_[region_]);
+    fences_[region_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void StreamBuffer::wait() noexcept { waitAndDeleteSync(fences_[region_]); }
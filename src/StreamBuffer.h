@@ -0,0 +1,77 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <array>
+#include <cstddef>
+#include <span>
+
+// Byte range of a buffer object. Bound with glBindBufferRange, so shaders
+// see exactly `size` bytes (BodyData's length() and the like).
+struct BufferRange {
+    GLuint buffer = 0;
+    GLintptr offset = 0;
+    GLsizeiptr size = 0;
+
+    void bind(GLenum target, GLuint index) const noexcept {
+        glBindBufferRange(target, index, buffer, offset, size);
+    }
+};
+
+// Persistently mapped, coherent buffer for data that crosses the bus every
+// frame or step, split into REGIONS regions that are each guarded by a
+// fence. The CPU fills region k+1 while the GPU may still be reading region
+// k, so uploads never re-specify storage or sync inside the driver; next()
+// only blocks if the GPU is a whole ring behind. A Readback ring is written
+// by the GPU and read by the CPU once wait() returns.
+//
+//     std::span<glm::vec4> bodies = stream.next<glm::vec4>(n); // fill
+//     stream.range().bind(GL_SHADER_STORAGE_BUFFER, 0);
+//     ... dispatches and draws reading binding 0 ...
+//     stream.fence();
+//
+// Storage is created on first use, so owners can be built without a
+// current context (the CPU physics backends).
+class StreamBuffer {
+  public:
+    enum Direction { Upload, Readback };
+    static constexpr int REGIONS = 3;
+
+    explicit StreamBuffer(Direction direction = Upload) noexcept
+        : direction_{direction} {}
+    ~StreamBuffer() noexcept;
+
+    StreamBuffer(const StreamBuffer &) = delete;
+    StreamBuffer &operator=(const StreamBuffer &) = delete;
+
+    // Moves on to the next region and returns its first `bytes` bytes.
+    // Outgrowing a region reallocates the ring with at least twice the room.
+    // Throws std::runtime_error if the storage can't be mapped.
+    void *next(size_t bytes);
+    template <class T> std::span<T> next(size_t count) {
+        return {static_cast<T *>(next(count * sizeof(T))), count};
+    }
+
+    // The part of the current region handed out by next(). Never empty, as
+    // GL rejects zero-sized ranges; an empty one reads back as length 0.
+    BufferRange range() const noexcept {
+        return {buffer_, GLintptr(region_ * regionBytes_),
+                GLsizeiptr(bytes_ > 0 ? bytes_ : 1)};
+    }
+
+    // Call after the last command that uses the current region.
+    void fence() noexcept;
+    // Readback: blocks until the GPU writes fenced in the current region
+    // are visible through the pointer next() returned.
+    void wait() noexcept;
+
+  private:
+    Direction direction_;
+    GLuint buffer_ = 0;
+    std::byte *mapped_ = nullptr;
+    size_t regionBytes_ = 0, bytes_ = 0;
+    size_t region_ = REGIONS - 1;
+    std::array<GLsync, REGIONS> fences_{};
+
+    void allocate(size_t bytes);
+    void release() noexcept;
+};
@@ -0,0 +1,73 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threads) {
+    unsigned extra = std::max(threads, 1u) - 1;
+    workers_.reserve(extra);
+    for (unsigned i = 0; i < extra; ++i)
+        workers_.emplace_back([this] { workerLoop(); });
+}
+
+ThreadPool::~ThreadPool() noexcept {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto &t : workers_)
+        t.join();
+}
+
+ThreadPool &ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::run(size_t count, size_t grain, void *ctx, Trampoline fn) {
+    std::lock_guard runLock(runMutex_);
+    {
+        std::lock_guard lock(mutex_);
+        ctx_ = ctx;
+        fn_ = fn;
+        count_ = count;
+        grain_ = grain;
+        next_.store(0, std::memory_order_relaxed);
+        busy_.store(static_cast<unsigned>(workers_.size()),
+                    std::memory_order_relaxed);
+        ++generation_;
+    }
+    wake_.notify_all();
+
+    drain();
+
+    std::unique_lock lock(mutex_);
+    done_.wait(lock, [&] { return busy_.load() == 0; });
+}
+
+void ThreadPool::drain() noexcept {
+    for (;;) {
+        size_t begin = next_.fetch_add(grain_, std::memory_order_relaxed);
+        if (begin >= count_)
+            return;
+        fn_(ctx_, begin, std::min(begin + grain_, count_));
+    }
+}
+
+void ThreadPool::workerLoop() {
+    unsigned seen = 0;
+    for (;;) {
+        {
+            std::unique_lock lock(mutex_);
+            wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_)
+                return;
+            seen = generation_;
+        }
+        drain();
+        if (busy_.fetch_sub(1) == 1) {
+            std::lock_guard lock(mutex_);
+            done_.notify_one();
+        }
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel loops. The calling thread
+// takes part in every loop, so a pool of size 1 runs everything inline.
+class ThreadPool {
+  public:
+    explicit ThreadPool(unsigned threads = std::thread::hardware_concurrency());
+    ~ThreadPool() noexcept;
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned size() const noexcept {
+        return static_cast<unsigned>(workers_.size()) + 1;
+    }
+
+    // Calls f(begin, end) over [0, count) in chunks of at most `grain`.
+    template <class F> void parallelFor(size_t count, size_t grain, F &&f) {
+        if (count == 0)
+            return;
+        if (grain == 0)
+            grain = 1;
+        if (workers_.empty() || count <= grain) {
+            for (size_t b = 0; b < count; b += grain)
+                f(b, std::min(b + grain, count));
+            return;
+        }
+        run(count, grain, &f, [](void *ctx, size_t b, size_t e) {
+            (*static_cast<std::remove_reference_t<F> *>(ctx))(b, e);
+        });
+    }
+
+    static ThreadPool &shared();
+
+  private:
+    using Trampoline = void (*)(void *, size_t, size_t);
+
+    std::vector<std::thread> workers_;
+    std::mutex runMutex_;
+    std::mutex mutex_;
+    std::condition_variable wake_, done_;
+    bool stop_ = false;
+    unsigned generation_ = 0;
+
+    void *ctx_ = nullptr;
+    Trampoline fn_ = nullptr;
+    size_t count_ = 0, grain_ = 0;
+    std::atomic<size_t> next_{0};
+    std::atomic<unsigned> busy_{0};
+
+    void run(size_t count, size_t grain, void *ctx, Trampoline fn);
+    void drain() noexcept;
+    void workerLoop();
+};
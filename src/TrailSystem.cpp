@@ -0,0 +1,117 @@
+#include "TrailSystem.h"
+#include "CelestialBody.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <glm/gtc/type_ptr.hpp>
+
+namespace {
+// Grows `buffer` to `bytes`, keeping the first `keep` bytes and zeroing
+// the rest.
+void grow(Buffer &buffer, size_t keep, size_t bytes) {
+    Buffer grown;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, grown.id);
+    glBufferData(GL_COPY_WRITE_BUFFER, bytes, nullptr, GL_DYNAMIC_COPY);
+    glClearBufferData(GL_COPY_WRITE_BUFFER, GL_R32UI, GL_RED_INTEGER,
+                      GL_UNSIGNED_INT, nullptr);
+    if (keep > 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer.id);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                            keep);
+    }
+    buffer = std::move(grown);
+}
+} // namespace
+
+TrailSystem::TrailSystem()
+    : updateShader_{"shaders/trail_update.comp",
+                    {{"HISTORY", int(HISTORY)},
+                     {"CHUNK", int(CHUNK)},
+                     {"PER_BODY", int(PER_BODY)}}} {
+    GLuint prog = updateShader_.id();
+    locCount_ = glGetUniformLocation(prog, "u_Count");
+    locTime_ = glGetUniformLocation(prog, "u_Time");
+    locLife_ = glGetUniformLocation(prog, "u_Life");
+    locView_ = glGetUniformLocation(prog, "u_View");
+    locPixelScale_ = glGetUniformLocation(prog, "u_PixelScale");
+    locTolerance_ = glGetUniformLocation(prog, "u_TolerancePixels");
+    locRetire_ = glGetUniformLocation(prog, "u_RetireFactor");
+    locMaxSegment_ = glGetUniformLocation(prog, "u_MaxSegmentTime");
+}
+
+void TrailSystem::sync(
+    const std::vector<std::unique_ptr<CelestialBody>> &bodies,
+    size_t particles) {
+    if (particles > capacity_) {
+        size_t capacity = std::max(particles, capacity_ * 2);
+        grow(points_, count_ * PER_BODY * sizeof(glm::vec4),
+             capacity * PER_BODY * sizeof(glm::vec4));
+        grow(states_, count_ * STATE_BYTES, capacity * STATE_BYTES);
+        grow(commands_, 0, capacity * COMMANDS_PER_BODY * COMMAND_BYTES);
+        capacity_ = capacity;
+    }
+    count_ = particles;
+
+    colorStaging_.assign(particles, glm::vec4{0.0f});
+    for (const auto &b : bodies)
+        if (b->getIndex() < particles)
+            colorStaging_[b->getIndex()] = glm::vec4{b->getTrailColor(), 1.0f};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, colors_.id);
+    glBufferData(GL_SHADER_STORAGE_BUFFER,
+                 colorStaging_.size() * sizeof(glm::vec4),
+                 colorStaging_.data(), GL_DYNAMIC_DRAW);
+}
+
+void TrailSystem::clear() noexcept {
+    // A zeroed state is an empty trail, as for freshly grown buffers.
+    if (capacity_ > 0) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, states_.id);
+        glClearBufferData(GL_COPY_WRITE_BUFFER, GL_R32UI, GL_RED_INTEGER,
+                          GL_UNSIGNED_INT, nullptr);
+    }
+    count_ = 0;
+}
+
+void TrailSystem::update(BufferRange bodies, const glm::mat4 &view,
+                         float pixelScale) noexcept {
+    PROFILE_ZONE("TrailSystem::update");
+    if (count_ == 0)
+        return;
+
+    updateShader_.bind();
+    glUniform1ui(locCount_, GLuint(count_));
+    glUniform1f(locTime_, float(time_));
+    glUniform1f(locLife_, POINT_LIFE);
+    glUniformMatrix4fv(locView_, 1, GL_FALSE, glm::value_ptr(view));
+    glUniform1f(locPixelScale_, pixelScale);
+    glUniform1f(locTolerance_, tolerancePixels_);
+    glUniform1f(locRetire_, RETIRE_FACTOR);
+    glUniform1f(locMaxSegment_, MAX_SEGMENT_TIME);
+    bodies.bind(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, points_.id);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, colors_.id);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, states_.id);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, commands_.id);
+    updateShader_.dispatch(static_cast<int>(count_));
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+}
+
+void TrailSystem::draw(const Program &prog,
+                       const glm::mat4 &viewProj) noexcept {
+    if (count_ == 0)
+        return;
+
+    prog.use();
+    glUniformMatrix4fv(prog.uniform("u_MVP"), 1, GL_FALSE,
+                       glm::value_ptr(viewProj));
+    glUniform1ui(prog.uniform("u_Stride"), PER_BODY);
+    glUniform1f(prog.uniform("u_Time"), float(time_));
+    glUniform1f(prog.uniform("u_Life"), POINT_LIFE);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, points_.id);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, colors_.id);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands_.id);
+    glBindVertexArray(emptyVAO_.id);
+    glMultiDrawArraysIndirect(GL_LINE_STRIP, nullptr,
+                              GLsizei(count_ * COMMANDS_PER_BODY), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "ComputeShader.h"
+#include "StreamBuffer.h"
+#include "raii.h"
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+
+class CelestialBody;
+
+// Trails for every particle, kept entirely on the GPU. Each frame a compute
+// pass samples the body SSBO adaptively: a point is committed only when
+// leaving it out would bend the trail by more than a screen-space
+// tolerance. Full chunks of samples are then simplified with
+// Douglas-Peucker into a per-particle history ring. The same pass writes
+// indirect commands, so every trail draws with one
+// glMultiDrawArraysIndirect.
+class TrailSystem {
+  public:
+    static constexpr float POINT_LIFE = 60.0f;
+    // Longest segment committed on a straight path, so fading stays smooth.
+    static constexpr float MAX_SEGMENT_TIME = 2.0f;
+    static constexpr GLuint HISTORY = 256;
+    static constexpr GLuint CHUNK = 32; // recent samples per retire
+    static constexpr float RETIRE_FACTOR = 2.0f;
+
+    TrailSystem();
+
+    void advance(float dt) noexcept { time_ += dt; }
+
+    // Allowed deviation of a trail from the true path, in pixels.
+    void setTolerance(float pixels) noexcept { tolerancePixels_ = pixels; }
+    float getTolerance() const noexcept { return tolerancePixels_; }
+
+    size_t size() const noexcept { return count_; }
+
+    // Matches the trails to `particles` particles and refreshes colours.
+    void sync(const std::vector<std::unique_ptr<CelestialBody>> &bodies,
+              size_t particles);
+    // Forgets every trail, e.g. when all bodies jump to a loaded state. The
+    // next sync() starts them afresh.
+    void clear() noexcept;
+
+    // Samples every particle from `bodies`. pixelScale is the world size
+    // of one pixel at unit depth.
+    void update(BufferRange bodies, const glm::mat4 &view,
+                float pixelScale) noexcept;
+
+    // Draws with the trail.vert/trail.frag program.
+    void draw(const Program &prog, const glm::mat4 &viewProj) noexcept;
+
+  private:
+    // History ring, its mirror of slot 0, then the recent chunk.
+    static constexpr GLuint PER_BODY = HISTORY + 1 + CHUNK;
+    static constexpr size_t STATE_BYTES = 48;   // TrailState in the shader
+    static constexpr size_t COMMAND_BYTES = 16; // DrawArraysIndirectCommand
+    static constexpr size_t COMMANDS_PER_BODY = 3;
+
+    ComputeShader updateShader_;
+    GLint locCount_ = -1, locTime_ = -1, locLife_ = -1, locView_ = -1;
+    GLint locPixelScale_ = -1, locTolerance_ = -1, locRetire_ = -1;
+    GLint locMaxSegment_ = -1;
+    VertexArray emptyVAO_; // attribute-less; core profile needs one bound
+
+    Buffer points_, states_, commands_, colors_;
+    size_t capacity_ = 0; // particles the buffers hold
+    size_t count_ = 0;
+    std::vector<glm::vec4> colorStaging_;
+
+    double time_ = 0.0;
+    float tolerancePixels_ = 0.5f;
+};
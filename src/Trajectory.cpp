@@ -0,0 +1,412 @@
+#include "Trajectory.h"
+#include "Endian.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+constexpr char MAGIC[8] = {'S', 'P', 'T', 'M', 'T', 'R', 'A', 'J'};
+constexpr size_t HEADER_BYTES = 64;
+constexpr int COMPONENTS = 6;
+// Quantized magnitudes are clamped here so predictions can't overflow.
+constexpr double MAX_QUANTA = 1e18;
+
+template <class T> void putLittle(std::vector<uint8_t> &out, T v) {
+    v = little(v);
+    const auto *p = reinterpret_cast<const uint8_t *>(&v);
+    out.insert(out.end(), p, p + sizeof v);
+}
+
+[[noreturn]] void corrupt() {
+    throw std::runtime_error("trajectory file is truncated or corrupt");
+}
+
+template <class T> T getLittle(const uint8_t *&in, const uint8_t *end) {
+    T v;
+    if (size_t(end - in) < sizeof v)
+        corrupt();
+    std::memcpy(&v, in, sizeof v);
+    in += sizeof v;
+    return little(v);
+}
+
+void putVarint(std::vector<uint8_t> &out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(uint8_t(v) | 0x80);
+        v >>= 7;
+    }
+    out.push_back(uint8_t(v));
+}
+
+uint64_t getVarint(const uint8_t *&in, const uint8_t *end) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (in == end)
+            corrupt();
+        uint8_t b = *in++;
+        v |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return v;
+    }
+    corrupt();
+}
+
+// Small magnitudes of either sign map to small codes.
+uint64_t zigzag(uint64_t d) noexcept {
+    return (d << 1) ^ uint64_t(int64_t(d) >> 63);
+}
+uint64_t unzigzag(uint64_t z) noexcept { return (z >> 1) ^ (0 - (z & 1)); }
+
+// Prediction of a quantized value from its two predecessors in the chunk:
+// nothing, then the last value, then linear extrapolation. Unsigned
+// arithmetic wraps identically when encoding and decoding.
+uint64_t predict(uint32_t frame, uint64_t last, uint64_t beforeLast) noexcept {
+    return frame == 0 ? 0 : frame == 1 ? last : 2 * last - beforeLast;
+}
+
+uint64_t quantize(double x, double inverseQuantum) noexcept {
+    double q = std::round(x * inverseQuantum);
+    if (!(q > -MAX_QUANTA)) // also NaN
+        q = std::isnan(q) ? 0.0 : -MAX_QUANTA;
+    return uint64_t(int64_t(std::min(q, MAX_QUANTA)));
+}
+
+std::vector<uint8_t> header(const Trajectory::Options &o,
+                            uint64_t indexOffset, uint64_t frames) {
+    std::vector<uint8_t> h(MAGIC, MAGIC + sizeof MAGIC);
+    putLittle(h, Trajectory::VERSION);
+    putLittle(h, uint32_t(HEADER_BYTES));
+    putLittle(h, o.every);
+    putLittle(h, o.positionQuantum);
+    putLittle(h, o.velocityQuantum);
+    putLittle(h, Trajectory::CHUNK_FRAMES);
+    putLittle(h, Trajectory::BLOCK_BODIES);
+    putLittle(h, indexOffset);
+    putLittle(h, frames);
+    return h;
+}
+} // namespace
+
+namespace Trajectory {
+Recorder::Recorder(const std::string &path, const Options &options)
+    : options_{options} {
+    if (options_.every == 0 || !(options_.positionQuantum > 0.0) ||
+        !(options_.velocityQuantum > 0.0))
+        throw std::invalid_argument("trajectory interval and quanta must be "
+                                    "positive");
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_)
+        throw std::runtime_error("cannot write trajectory " + path);
+    // Rewritten with the index offset once finished.
+    std::vector<uint8_t> h = header(options_, 0, 0);
+    put(h.data(), h.size());
+    thread_ = std::thread([this] { loop(); });
+}
+
+Recorder::~Recorder() noexcept { close(); }
+
+void Recorder::capture(const ParticleStore &store, double time,
+                       uint64_t step) {
+    if (finished_)
+        return;
+    PROFILE_ZONE("Trajectory::capture");
+    captured_.fetch_add(1, std::memory_order_relaxed);
+    Frame *frame = queue_.write();
+    if (!frame) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    size_t n = store.size();
+    frame->time = time;
+    frame->step = step;
+    frame->count = n;
+    frame->state.resize(COMPONENTS * n);
+    double *out = frame->state.data();
+    for (const auto *a : {&store.px, &store.py, &store.pz, &store.vx,
+                          &store.vy, &store.vz}) {
+        std::copy_n(a->data(), n, out);
+        out += n;
+    }
+    queue_.push();
+}
+
+void Recorder::finish() noexcept {
+    if (finished_)
+        return;
+    finished_ = true;
+    queue_.close();
+}
+
+void Recorder::close() noexcept {
+    finish();
+    if (thread_.joinable())
+        thread_.join();
+}
+
+Recorder::Stats Recorder::stats() const noexcept {
+    return {captured_.load(std::memory_order_relaxed),
+            dropped_.load(std::memory_order_relaxed),
+            written_.load(std::memory_order_relaxed),
+            bytes_.load(std::memory_order_relaxed),
+            failed_.load(std::memory_order_relaxed)};
+}
+
+void Recorder::put(const void *data, size_t bytes) {
+    if (failed_.load(std::memory_order_relaxed))
+        return;
+    if (std::fwrite(data, 1, bytes, file_) != bytes)
+        failed_ = true;
+    bytes_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void Recorder::loop() {
+    Profiler::setThreadName("trajectory");
+    while (const Frame *frame = queue_.wait()) {
+        if (!failed_.load(std::memory_order_relaxed))
+            encode(*frame);
+        queue_.pop();
+    }
+    flushChunk();
+    writeIndex();
+    if (std::fclose(file_) != 0)
+        failed_ = true;
+    file_ = nullptr;
+}
+
+void Recorder::encode(const Frame &frame) {
+    PROFILE_ZONE("Trajectory::encode");
+    size_t n = frame.count;
+    if (chunkFrames_ == CHUNK_FRAMES ||
+        (chunkFrames_ > 0 && n != chunkBodies_))
+        flushChunk();
+    if (chunkFrames_ == 0) {
+        chunkBodies_ = n;
+        blocks_.resize((n + BLOCK_BODIES - 1) / BLOCK_BODIES);
+        for (std::vector<uint8_t> &block : blocks_)
+            block.clear();
+        last_.assign(COMPONENTS * n, 0);
+        beforeLast_.assign(COMPONENTS * n, 0);
+    }
+    frames_.push_back({frame.time, frame.step});
+
+    const double inverse[2] = {1.0 / options_.positionQuantum,
+                               1.0 / options_.velocityQuantum};
+    for (size_t b = 0; b < blocks_.size(); ++b) {
+        size_t begin = b * BLOCK_BODIES;
+        size_t end = std::min(n, begin + BLOCK_BODIES);
+        for (int c = 0; c < COMPONENTS; ++c) {
+            const double *x = frame.state.data() + c * n;
+            uint64_t *last = last_.data() + c * n;
+            uint64_t *beforeLast = beforeLast_.data() + c * n;
+            for (size_t i = begin; i < end; ++i) {
+                uint64_t q = quantize(x[i], inverse[c / 3]);
+                uint64_t predicted =
+                    predict(chunkFrames_, last[i], beforeLast[i]);
+                putVarint(blocks_[b], zigzag(q - predicted));
+                beforeLast[i] = last[i];
+                last[i] = q;
+            }
+        }
+    }
+    ++chunkFrames_;
+    written_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Recorder::flushChunk() {
+    if (chunkFrames_ == 0)
+        return;
+    chunks_.push_back({frames_.size() - chunkFrames_, chunkFrames_,
+                       uint32_t(chunkBodies_), offsets_.size()});
+    for (const std::vector<uint8_t> &block : blocks_) {
+        offsets_.push_back(bytes_.load(std::memory_order_relaxed));
+        put(block.data(), block.size());
+    }
+    offsets_.push_back(bytes_.load(std::memory_order_relaxed));
+    chunkFrames_ = 0;
+}
+
+void Recorder::writeIndex() {
+    std::vector<uint8_t> index;
+    putLittle(index, uint64_t(frames_.size()));
+    for (const FrameInfo &f : frames_) {
+        putLittle(index, f.time);
+        putLittle(index, f.step);
+    }
+    putLittle(index, uint64_t(chunks_.size()));
+    for (size_t k = 0; k < chunks_.size(); ++k) {
+        const ChunkInfo &c = chunks_[k];
+        putLittle(index, c.firstFrame);
+        putLittle(index, c.frames);
+        putLittle(index, c.bodies);
+        size_t last = k + 1 < chunks_.size() ? chunks_[k + 1].firstOffset
+                                             : offsets_.size();
+        for (size_t o = c.firstOffset; o < last; ++o)
+            putLittle(index, offsets_[o]);
+    }
+
+    uint64_t indexOffset = bytes_.load(std::memory_order_relaxed);
+    put(index.data(), index.size());
+    std::vector<uint8_t> h = header(options_, indexOffset, frames_.size());
+    if (!failed_ && (std::fseek(file_, 0, SEEK_SET) != 0 ||
+                     std::fwrite(h.data(), 1, h.size(), file_) != h.size()))
+        failed_ = true;
+}
+
+Reader::Reader(const std::string &path) : file_{path, std::ios::binary} {
+    if (!file_)
+        throw std::runtime_error("cannot open trajectory " + path);
+    load(0, HEADER_BYTES);
+    const uint8_t *in = bytes_.data(), *end = in + bytes_.size();
+    if (std::memcmp(in, MAGIC, sizeof MAGIC) != 0)
+        throw std::runtime_error(path + " is not a trajectory");
+    in += sizeof MAGIC;
+    if (uint32_t v = getLittle<uint32_t>(in, end); v != VERSION)
+        throw std::runtime_error(path + " is trajectory version " +
+                                 std::to_string(v) + ", expected " +
+                                 std::to_string(VERSION));
+    getLittle<uint32_t>(in, end); // header size, for later versions
+    options_.every = getLittle<uint64_t>(in, end);
+    options_.positionQuantum = getLittle<double>(in, end);
+    options_.velocityQuantum = getLittle<double>(in, end);
+    chunkFrames_ = getLittle<uint32_t>(in, end);
+    blockBodies_ = getLittle<uint32_t>(in, end);
+    uint64_t indexOffset = getLittle<uint64_t>(in, end);
+    uint64_t frameCount = getLittle<uint64_t>(in, end);
+    if (indexOffset == 0)
+        throw std::runtime_error(path + " was not finished");
+    if (chunkFrames_ == 0 || blockBodies_ == 0)
+        corrupt();
+
+    file_.seekg(0, std::ios::end);
+    uint64_t size = uint64_t(file_.tellg());
+    if (indexOffset < HEADER_BYTES || indexOffset > size)
+        corrupt();
+    load(indexOffset, size - indexOffset);
+    in = bytes_.data();
+    end = in + bytes_.size();
+
+    if (getLittle<uint64_t>(in, end) != frameCount ||
+        frameCount > size_t(end - in) / 16)
+        corrupt();
+    frames_.resize(frameCount);
+    for (FrameInfo &f : frames_) {
+        f.time = getLittle<double>(in, end);
+        f.step = getLittle<uint64_t>(in, end);
+    }
+
+    uint64_t chunkCount = getLittle<uint64_t>(in, end);
+    uint64_t nextFrame = 0, nextOffset = HEADER_BYTES;
+    for (uint64_t k = 0; k < chunkCount; ++k) {
+        ChunkInfo c;
+        c.firstFrame = getLittle<uint64_t>(in, end);
+        c.frames = getLittle<uint32_t>(in, end);
+        c.bodies = getLittle<uint32_t>(in, end);
+        if (c.firstFrame != nextFrame || c.frames == 0 ||
+            c.frames > chunkFrames_ || c.frames > frameCount - nextFrame)
+            corrupt();
+        size_t blocks = (size_t(c.bodies) + blockBodies_ - 1) / blockBodies_;
+        if (blocks + 1 > size_t(end - in) / 8)
+            corrupt();
+        c.offsets.resize(blocks + 1);
+        for (uint64_t &o : c.offsets) {
+            o = getLittle<uint64_t>(in, end);
+            if (o < nextOffset || o > indexOffset)
+                corrupt();
+            nextOffset = o;
+        }
+        nextFrame += c.frames;
+        chunks_.push_back(std::move(c));
+    }
+    if (nextFrame != frameCount)
+        corrupt();
+}
+
+void Reader::load(uint64_t offset, uint64_t size) {
+    bytes_.resize(size);
+    file_.clear();
+    file_.seekg(std::streamoff(offset));
+    file_.read(reinterpret_cast<char *>(bytes_.data()),
+               std::streamsize(size));
+    if (!file_)
+        corrupt();
+}
+
+const Reader::ChunkInfo &Reader::chunkOf(size_t frame) const {
+    if (frame >= frames_.size())
+        throw std::out_of_range("trajectory frame " + std::to_string(frame) +
+                                " of " + std::to_string(frames_.size()));
+    auto it = std::upper_bound(
+        chunks_.begin(), chunks_.end(), frame,
+        [](size_t f, const ChunkInfo &c) { return f < c.firstFrame; });
+    return *(it - 1);
+}
+
+size_t Reader::bodies(size_t frame) const { return chunkOf(frame).bodies; }
+
+template <class Visit>
+void Reader::decodeBlock(const ChunkInfo &chunk, size_t block,
+                         uint32_t frames, Visit visit) {
+    blockSize_ = std::min<size_t>(blockBodies_,
+                                  chunk.bodies - block * blockBodies_);
+    load(chunk.offsets[block], chunk.offsets[block + 1] - chunk.offsets[block]);
+    last_.assign(COMPONENTS * blockSize_, 0);
+    beforeLast_.assign(COMPONENTS * blockSize_, 0);
+
+    const uint8_t *in = bytes_.data(), *end = in + bytes_.size();
+    for (uint32_t f = 0; f < frames; ++f) {
+        for (size_t k = 0; k < last_.size(); ++k) {
+            uint64_t q = predict(f, last_[k], beforeLast_[k]) +
+                         unzigzag(getVarint(in, end));
+            beforeLast_[k] = last_[k];
+            last_[k] = q;
+        }
+        visit(f);
+    }
+}
+
+glm::dvec3 Reader::value(size_t i, int first) const noexcept {
+    double quantum =
+        first < 3 ? options_.positionQuantum : options_.velocityQuantum;
+    glm::dvec3 v;
+    for (int c = 0; c < 3; ++c)
+        v[c] = double(int64_t(last_[(first + c) * blockSize_ + i])) * quantum;
+    return v;
+}
+
+void Reader::readFrame(size_t frame, std::vector<glm::dvec3> &positions,
+                       std::vector<glm::dvec3> &velocities) {
+    const ChunkInfo &chunk = chunkOf(frame);
+    uint32_t frames = uint32_t(frame - chunk.firstFrame) + 1;
+    positions.resize(chunk.bodies);
+    velocities.resize(chunk.bodies);
+    for (size_t b = 0; b + 1 < chunk.offsets.size(); ++b) {
+        decodeBlock(chunk, b, frames, [](uint32_t) {});
+        for (size_t i = 0; i < blockSize_; ++i) {
+            positions[b * blockBodies_ + i] = value(i, 0);
+            velocities[b * blockBodies_ + i] = value(i, 3);
+        }
+    }
+}
+
+void Reader::readBody(size_t body, std::vector<glm::dvec3> &positions,
+                      std::vector<glm::dvec3> &velocities) {
+    glm::dvec3 missing{std::numeric_limits<double>::quiet_NaN()};
+    positions.assign(frames_.size(), missing);
+    velocities.assign(frames_.size(), missing);
+    size_t block = body / blockBodies_, i = body % blockBodies_;
+    for (const ChunkInfo &chunk : chunks_) {
+        if (body >= chunk.bodies)
+            continue;
+        decodeBlock(chunk, block, chunk.frames, [&](uint32_t f) {
+            positions[chunk.firstFrame + f] = value(i, 0);
+            velocities[chunk.firstFrame + f] = value(i, 3);
+        });
+    }
+}
+} // namespace Trajectory
@@ -0,0 +1,178 @@
+#pragma once
+
+#include "ParticleStore.h"
+#include "SpscQueue.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <glm/glm.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Trajectory files hold positions and velocities every few steps, small
+// enough to keep whole runs. Values are quantized to fixed quanta and each
+// is stored as a zigzag varint of its second difference over time, which
+// is tiny on smooth orbits. Frames are grouped into chunks of CHUNK_FRAMES,
+// and the bodies of a chunk into blocks of BLOCK_BODIES:
+//
+//     offset 0        Header (64 bytes, little-endian)
+//     chunk k         block 0 | block 1 | ...
+//     indexOffset     frame times and steps, chunk and block offsets
+//
+// A block holds its frames in order, each as px of every body in the
+// block, then py, pz, vx, vy and vz. Prediction restarts at every chunk,
+// so the index leads straight to one frame (decode one chunk up to it) or
+// to one body's history (decode its block in every chunk). The index is
+// written when recording finishes.
+namespace Trajectory {
+constexpr uint32_t VERSION = 1;
+constexpr uint32_t CHUNK_FRAMES = 32;
+constexpr uint32_t BLOCK_BODIES = 4096;
+
+struct Options {
+    uint64_t every = 10; // steps between frames
+    double positionQuantum = 1e-4;
+    double velocityQuantum = 1e-5;
+};
+
+// Captures frames on the simulation thread and encodes them on a writer
+// thread. capture() only copies the state into a free queue slot, so the
+// step loop never waits on encoding or I/O; a frame arriving while every
+// slot is still queued is dropped and counted.
+class Recorder {
+  public:
+    static constexpr size_t QUEUE_FRAMES = 8;
+
+    // Creates `path` and starts the writer. Throws std::invalid_argument
+    // on a zero interval or quantum and std::runtime_error if the file
+    // can't be created.
+    Recorder(const std::string &path, const Options &options);
+    ~Recorder() noexcept;
+
+    Recorder(const Recorder &) = delete;
+    Recorder &operator=(const Recorder &) = delete;
+
+    // Whether the state after `step` is recorded.
+    bool due(uint64_t step) const noexcept {
+        return step % options_.every == 0;
+    }
+
+    // Producer side, all from one thread.
+    void capture(const ParticleStore &store, double time, uint64_t step);
+    // Ends the recording; the writer drains the queue and writes the index.
+    void finish() noexcept;
+    // finish(), then waits for the writer to close the file.
+    void close() noexcept;
+
+    struct Stats {
+        uint64_t captured = 0;
+        uint64_t dropped = 0;
+        uint64_t written = 0;
+        uint64_t bytes = 0;
+        bool failed = false; // an I/O error; later frames are discarded
+    };
+    Stats stats() const noexcept;
+
+  private:
+    struct Frame {
+        double time = 0.0;
+        uint64_t step = 0;
+        size_t count = 0;
+        std::vector<double> state; // px, py, pz, vx, vy, vz; count each
+    };
+    struct FrameInfo {
+        double time;
+        uint64_t step;
+    };
+    struct ChunkInfo {
+        uint64_t firstFrame;
+        uint32_t frames;
+        uint32_t bodies;
+        size_t firstOffset; // into offsets_
+    };
+
+    Options options_;
+    std::FILE *file_ = nullptr;
+    SpscQueue<Frame, QUEUE_FRAMES> queue_;
+    bool finished_ = false; // producer side
+
+    std::atomic<uint64_t> captured_{0}, dropped_{0}, written_{0}, bytes_{0};
+    std::atomic<bool> failed_{false};
+
+    // Writer thread state. The chunk being built keeps each block's bytes
+    // until it is complete, and the last two quantized frames.
+    uint32_t chunkFrames_ = 0;
+    size_t chunkBodies_ = 0;
+    std::vector<std::vector<uint8_t>> blocks_;
+    std::vector<uint64_t> last_, beforeLast_;
+    std::vector<FrameInfo> frames_;
+    std::vector<ChunkInfo> chunks_;
+    std::vector<uint64_t> offsets_;
+
+    std::thread thread_;
+
+    void loop();
+    void encode(const Frame &frame);
+    void flushChunk();
+    void writeIndex();
+    void put(const void *data, size_t bytes);
+};
+
+// Random access to a finished trajectory file. Only the blocks a read
+// needs are loaded and decoded. Throws std::runtime_error on files that
+// are unreadable, unfinished, corrupt or of another version.
+class Reader {
+  public:
+    explicit Reader(const std::string &path);
+
+    size_t frames() const noexcept { return frames_.size(); }
+    double time(size_t frame) const { return frames_.at(frame).time; }
+    uint64_t step(size_t frame) const { return frames_.at(frame).step; }
+    size_t bodies(size_t frame) const;
+
+    // Every body's state at `frame`, decoding only its chunk up to it.
+    void readFrame(size_t frame, std::vector<glm::dvec3> &positions,
+                   std::vector<glm::dvec3> &velocities);
+    // One body's state at every frame, decoding its block of each chunk.
+    // Frames recorded before the body existed read as NaN.
+    void readBody(size_t body, std::vector<glm::dvec3> &positions,
+                  std::vector<glm::dvec3> &velocities);
+
+  private:
+    struct FrameInfo {
+        double time;
+        uint64_t step;
+    };
+    struct ChunkInfo {
+        uint64_t firstFrame;
+        uint32_t frames;
+        uint32_t bodies;
+        std::vector<uint64_t> offsets; // per block, plus the end
+    };
+
+    std::ifstream file_;
+    Options options_;
+    uint32_t chunkFrames_ = 0, blockBodies_ = 0;
+    std::vector<FrameInfo> frames_;
+    std::vector<ChunkInfo> chunks_;
+    std::vector<uint8_t> bytes_;
+    // Quantized values of the block being decoded, component-major.
+    std::vector<uint64_t> last_, beforeLast_;
+    size_t blockSize_ = 0;
+
+    const ChunkInfo &chunkOf(size_t frame) const;
+    void load(uint64_t offset, uint64_t size);
+    // Decodes the first `frames` frames of one block, calling visit(frame)
+    // after each.
+    template <class Visit>
+    void decodeBlock(const ChunkInfo &chunk, size_t block, uint32_t frames,
+                     Visit visit);
+    // Position (first = 0) or velocity (first = 3) of the block's body i
+    // at the last decoded frame.
+    glm::dvec3 value(size_t i, int first) const noexcept;
+};
+} // namespace Trajectory
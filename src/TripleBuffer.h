@@ -0,0 +1,36 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+// Single-producer / single-consumer triple buffer. The writer fills back()
+// and publish()es it; the reader acquire()s the newest published slot.
+// Neither side ever blocks or sees a slot the other is using.
+template <class T> class TripleBuffer {
+  public:
+    T &back() noexcept { return slots_[back_]; }
+
+    void publish() noexcept {
+        back_ = middle_.exchange(back_ | FRESH, std::memory_order_acq_rel) &
+                INDEX;
+    }
+
+    // Returns true if a newer value than the current front() was taken.
+    bool acquire() noexcept {
+        if (!(middle_.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        front_ = middle_.exchange(front_, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    const T &front() const noexcept { return slots_[front_]; }
+
+  private:
+    static constexpr unsigned INDEX = 3;
+    static constexpr unsigned FRESH = 4;
+
+    std::array<T, 3> slots_{};
+    unsigned back_ = 0;
+    unsigned front_ = 1;
+    std::atomic<unsigned> middle_{2};
+};
@@ -1,7 +1,11 @@
+#include "Headless.h"
 #include "Simulation.h"
 
-int main() {
+int main(int argc, char **argv) {
     try {
+        if (auto opts = Headless::parseArgs(argc, argv))
+            return Headless::run(*opts);
+
         Simulation sim(1280, 720);
         sim.run();
     } catch (const std::exception &e) {
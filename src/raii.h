@@ -1,10 +1,12 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <cstddef>
 #include <glad/glad.h>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 
@@ -17,6 +19,19 @@
         }                                                                      \
     } while (0)
 
+// Blocks until `sync` has signalled, then deletes it. Null is a no-op.
+inline void waitAndDeleteSync(GLsync &sync) noexcept {
+    if (!sync)
+        return;
+    constexpr GLuint64 TIMEOUT_NS = 1000000;
+    GLenum status;
+    do
+        status = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, TIMEOUT_NS);
+    while (status == GL_TIMEOUT_EXPIRED);
+    glDeleteSync(sync);
+    sync = nullptr;
+}
+
 struct GlObject {
     GlObject() = default;
     explicit GlObject(GLuint id) : id{id} {}
@@ -76,6 +91,22 @@ struct Texture2D : GlObject {
     Texture2D &operator=(Texture2D &&) = default;
 };
 
+struct Texture2DArray : GlObject {
+    Texture2DArray() {
+        glGenTextures(1, &id);
+        CHECK_GL();
+    }
+    ~Texture2DArray() {
+        if (id)
+            glDeleteTextures(1, &id);
+        CHECK_GL();
+    }
+    Texture2DArray(const Texture2DArray &) = delete;
+    Texture2DArray &operator=(const Texture2DArray &) = delete;
+    Texture2DArray(Texture2DArray &&) = default;
+    Texture2DArray &operator=(Texture2DArray &&) = default;
+};
+
 template <class T, size_t N> class RingBuffer {
     std::array<T, N> buf_;
     size_t head_ = 0, count_ = 0;
@@ -132,13 +163,24 @@ struct Program {
         CHECK_GL();
     }
 
+    // Every active uniform's location is cached when the program links;
+    // names the linker dropped read as -1, as from glGetUniformLocation.
     [[nodiscard]] GLint uniform(const char *name) const noexcept {
-        auto it = uniformLocations_.find(name);
+        auto it = uniformLocations_.find(std::string_view{name});
         return it != uniformLocations_.end() ? it->second : -1;
     }
 
+    // Heterogeneous lookup, so uniform() never builds a std::string.
+    struct NameHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const noexcept {
+            return std::hash<std::string_view>{}(s);
+        }
+    };
+
     GLuint id = 0;
-    std::unordered_map<std::string, GLint> uniformLocations_;
+    std::unordered_map<std::string, GLint, NameHash, std::equal_to<>>
+        uniformLocations_;
 
     static Program fromSources(const std::string &vertSrc,
                                const std::string &fragSrc) {
@@ -190,13 +232,20 @@ struct Program {
         CHECK_GL();
 
         Program prg{p};
-        prg.uniformLocations_["u_MVP"] = glGetUniformLocation(p, "u_MVP");
-        CHECK_GL();
-        prg.uniformLocations_["u_Texture"] =
-            glGetUniformLocation(p, "u_Texture");
-        CHECK_GL();
-        prg.uniformLocations_["u_TrailColor"] =
-            glGetUniformLocation(p, "u_TrailColor");
+        GLint count = 0, longest = 0;
+        glGetProgramiv(p, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(p, GL_ACTIVE_UNIFORM_MAX_LENGTH, &longest);
+        std::string name(size_t(std::max(longest, 1)), '\0');
+        for (GLint i = 0; i < count; ++i) {
+            GLsizei length = 0;
+            glGetActiveUniformName(p, GLuint(i), GLsizei(name.size()),
+                                   &length, name.data());
+            std::string key = name.substr(0, size_t(length));
+            // Arrays are reported as "name[0]"; look them up by "name".
+            if (key.ends_with("[0]"))
+                key.resize(key.size() - 3);
+            prg.uniformLocations_[key] = glGetUniformLocation(p, key.c_str());
+        }
         CHECK_GL();
 
         return prg;
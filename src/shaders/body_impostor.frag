@@ -0,0 +1,46 @@
+#version 450 core
+
+flat in vec3 Center;
+flat in float Radius;
+flat in uint Layer;
+flat in float Coverage;
+out vec4 FragColor;
+
+uniform sampler2DArray u_Texture;
+uniform mat4 u_View;
+uniform mat4 u_Proj;
+uniform vec2 u_Viewport;
+
+const float PI = 3.14159265358979;
+
+void main() {
+    // Sub-pixel bodies: a soft sprite tinted by the texture's average colour.
+    if (Coverage < 1.0) {
+        vec2 p = gl_PointCoord * 2.0 - 1.0;
+        float falloff = max(1.0 - dot(p, p), 0.0);
+        vec3 avg = textureLod(u_Texture, vec3(0.5, 0.5, float(Layer)), 16.0).rgb;
+        FragColor = vec4(avg, Coverage * falloff);
+        gl_FragDepth = gl_FragCoord.z;
+        return;
+    }
+
+    // Ray from the eye through this pixel, intersected with the sphere.
+    vec2 ndc = gl_FragCoord.xy / u_Viewport * 2.0 - 1.0;
+    vec3 dir = vec3(ndc.x / u_Proj[0][0], ndc.y / u_Proj[1][1], -1.0);
+    float a = dot(dir, dir);
+    float b = dot(dir, Center);
+    float c = dot(Center, Center) - Radius * Radius;
+    float disc = b * b - a * c;
+    if (disc < 0.0)
+        discard;
+
+    vec3 hit = dir * ((b - sqrt(disc)) / a);
+    vec4 clip = u_Proj * vec4(hit, 1.0);
+    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+
+    // Same parameterisation as Mesh::uvSphere: z is the pole.
+    vec3 n = transpose(mat3(u_View)) * ((hit - Center) / Radius);
+    float u = fract(atan(n.y, n.x) / (2.0 * PI));
+    float v = acos(clamp(n.z, -1.0, 1.0)) / PI;
+    FragColor = texture(u_Texture, vec3(u, v, float(Layer)));
+}
@@ -0,0 +1,51 @@
+#version 450 core
+
+// Same layout as BodyData in gravity.comp: xyz position, w mass.
+layout(std430, binding = 0) readonly buffer BodyData {
+    vec4 bodies[];
+};
+
+struct Instance {
+    float scale;
+    uint layer;
+    uint body;
+    uint pad;
+};
+
+layout(std430, binding = 3) readonly buffer InstanceData {
+    Instance instances[];
+};
+
+uniform mat4 u_View;
+uniform mat4 u_Proj;
+uniform float u_ViewportHeight;
+// Bodies at least this many pixels across are left to the mesh pass.
+uniform float u_MeshPixels;
+
+// Smallest sprite drawn; bodies below it fade out instead of shrinking.
+const float MIN_POINT_SIZE = 2.0;
+
+flat out vec3 Center; // view space
+flat out float Radius;
+flat out uint Layer;
+flat out float Coverage;
+
+void main() {
+    Instance inst = instances[gl_VertexID];
+    vec4 viewPos = u_View * vec4(bodies[inst.body].xyz, 1.0);
+    float depth = -viewPos.z;
+    float diameter = inst.scale * u_Proj[1][1] * u_ViewportHeight / depth;
+
+    if (depth <= inst.scale || diameter >= u_MeshPixels) {
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0); // clipped
+        gl_PointSize = 1.0;
+        return;
+    }
+
+    Center = viewPos.xyz;
+    Radius = inst.scale;
+    Layer = inst.layer;
+    Coverage = min(diameter / MIN_POINT_SIZE, 1.0);
+    gl_PointSize = max(diameter, MIN_POINT_SIZE) + 1.0;
+    gl_Position = u_Proj * viewPos;
+}
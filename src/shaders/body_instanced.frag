@@ -0,0 +1,11 @@
+#version 450 core
+
+in vec2 TexCoord;
+flat in uint Layer;
+out vec4 FragColor;
+
+uniform sampler2DArray u_Texture;
+
+void main() {
+    FragColor = texture(u_Texture, vec3(TexCoord, float(Layer)));
+}
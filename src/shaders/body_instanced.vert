@@ -0,0 +1,39 @@
+#version 450 core
+
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec2 aTexCoord;
+
+// Same layout as BodyData in gravity.comp: xyz position, w mass.
+layout(std430, binding = 0) readonly buffer BodyData {
+    vec4 bodies[];
+};
+
+struct Instance {
+    float scale;
+    uint layer;
+    uint body;
+    uint pad;
+};
+
+layout(std430, binding = 3) readonly buffer InstanceData {
+    Instance instances[];
+};
+
+// Instances drawn as meshes this frame; the rest go to the impostor pass.
+layout(std430, binding = 4) readonly buffer MeshList {
+    uint meshList[];
+};
+
+// View-projection only; each instance's model transform is applied here.
+uniform mat4 u_MVP;
+
+out vec2 TexCoord;
+flat out uint Layer;
+
+void main() {
+    Instance inst = instances[meshList[gl_InstanceID]];
+    vec3 world = bodies[inst.body].xyz + aPos * inst.scale;
+    gl_Position = u_MVP * vec4(world, 1.0);
+    TexCoord = aTexCoord;
+    Layer = inst.layer;
+}
@@ -1,6 +1,9 @@
 #version 450
-layout(location = 0) in vec3 aPos;
+// Written by gravitywell.comp; GravityWell's index blocks pick the lines.
+layout(std430, binding = 9) readonly buffer WellVertices {
+    vec4 vertices[];
+};
 uniform mat4 u_MVP;
 void main() {
-    gl_Position = u_MVP * vec4(aPos, 1.0);
+    gl_Position = u_MVP * vec4(vertices[gl_VertexID].xyz, 1.0);
 }
@@ -1,12 +1,23 @@
 #version 450 core
 
-layout(location = 0) in vec3 a_Pos;
-layout(location = 1) in float a_LifeFrac;
-layout(location = 0) out float v_LifeFrac;
+// Written by trail_update.comp; gl_VertexID indexes it directly.
+layout(std430, binding = 5) readonly buffer TrailData {
+    vec4 points[];
+};
+
+layout(std430, binding = 6) readonly buffer TrailColors {
+    vec4 colors[];
+};
+
+layout(location = 0) out vec4 v_Color;
 uniform mat4 u_MVP;
+uniform uint u_Stride;
+uniform float u_Time;
+uniform float u_Life;
 
 void main() {
-    v_LifeFrac  = a_LifeFrac;
-    gl_Position = u_MVP * vec4(a_Pos, 1.0);
+    vec4 p = points[gl_VertexID];
+    float lifeFrac = 1.0 - (u_Time - p.w) / u_Life;
+    v_Color = vec4(colors[uint(gl_VertexID) / u_Stride].rgb, lifeFrac);
+    gl_Position = u_MVP * vec4(p.xyz, 1.0);
 }
-
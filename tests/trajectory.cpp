@@ -0,0 +1,164 @@
+// Round trip through a trajectory file: records synthetic orbits across
+// several chunks and more than one body block, adds bodies part-way, then
+// reads every frame and a few bodies' histories back. Exits non-zero if a
+// value is off by more than half a quantum or a body reads before it
+// existed.
+
+#include "ParticleStore.h"
+#include "Trajectory.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+constexpr size_t BODIES = Trajectory::BLOCK_BODIES + 904;
+constexpr size_t ADDED = 1500;
+constexpr uint64_t FRAMES = 3 * Trajectory::CHUNK_FRAMES + 5;
+constexpr uint64_t ADDED_AT = Trajectory::CHUNK_FRAMES + 7; // mid-chunk
+constexpr double DT = 0.05;
+
+const Trajectory::Options OPTIONS = {.every = 1};
+
+// Each frame's state as the Recorder saw it: px, py, pz, vx, vy, vz of
+// every body, component-major.
+using Frame = std::vector<double>;
+
+int failures = 0;
+
+void check(bool ok, const char *what, uint64_t frame, size_t body) {
+    if (ok)
+        return;
+    if (++failures <= 10)
+        std::fprintf(stderr, "%s: frame %llu body %zu\n", what,
+                     (unsigned long long)frame, body);
+}
+
+// Advances every body along a harmonic orbit whose frequency depends on
+// its index, so neighbours drift apart and second differences vary.
+void advance(ParticleStore &store) {
+    for (size_t i = 0; i < store.size(); ++i) {
+        double w2 = 0.01 * double(1 + i % 7);
+        for (auto [p, v] : {std::pair{&store.px, &store.vx},
+                            std::pair{&store.py, &store.vy},
+                            std::pair{&store.pz, &store.vz}}) {
+            (*v)[i] -= w2 * (*p)[i] * DT;
+            (*p)[i] += (*v)[i] * DT;
+        }
+    }
+}
+
+Frame snapshot(const ParticleStore &store) {
+    Frame frame;
+    frame.reserve(6 * store.size());
+    for (auto *a : {&store.px, &store.py, &store.pz, &store.vx, &store.vy,
+                    &store.vz})
+        frame.insert(frame.end(), a->begin(), a->begin() + store.size());
+    return frame;
+}
+
+bool within(double read, double truth, double quantum) {
+    return std::abs(read - truth) <= 0.5 * quantum * (1.0 + 1e-9);
+}
+
+void checkBody(const Frame &truth, size_t body, uint64_t frame,
+               const glm::dvec3 &position, const glm::dvec3 &velocity) {
+    size_t n = truth.size() / 6;
+    bool ok = true;
+    for (int c = 0; c < 3; ++c) {
+        ok &= within(position[c], truth[c * n + body],
+                     OPTIONS.positionQuantum);
+        ok &= within(velocity[c], truth[(3 + c) * n + body],
+                     OPTIONS.velocityQuantum);
+    }
+    check(ok, "value off by more than half a quantum", frame, body);
+}
+
+std::vector<Frame> record(const std::string &path) {
+    ParticleStore store;
+    auto add = [&](size_t count, double phase) {
+        for (size_t k = 0; k < count; ++k) {
+            double a = phase + 0.37 * double(k);
+            double r = 5.0 + double(k % 97);
+            store.add(1.0, {r * std::cos(a), r * std::sin(a), 0.01 * r},
+                      {-0.1 * std::sin(a), 0.1 * std::cos(a), 0.0});
+        }
+    };
+    add(BODIES, 0.0);
+
+    std::vector<Frame> truth;
+    Trajectory::Recorder recorder(path, OPTIONS);
+    for (uint64_t step = 0; step < FRAMES; ++step) {
+        if (step == ADDED_AT)
+            add(ADDED, 1.0);
+        advance(store);
+        truth.push_back(snapshot(store));
+        recorder.capture(store, double(step) * DT, step);
+        // Let the writer keep up so no frame is dropped.
+        while (recorder.stats().written +
+                   Trajectory::Recorder::QUEUE_FRAMES / 2 <=
+               recorder.stats().captured)
+            std::this_thread::yield();
+    }
+    recorder.close();
+
+    Trajectory::Recorder::Stats stats = recorder.stats();
+    check(!stats.failed, "recording failed", 0, 0);
+    check(stats.dropped == 0 && stats.written == FRAMES,
+          "frames missing from the recording", stats.written, 0);
+    return truth;
+}
+} // namespace
+
+int main() {
+    std::string path =
+        (std::filesystem::temp_directory_path() / "spacetime-test.traj")
+            .string();
+    try {
+        std::vector<Frame> truth = record(path);
+        Trajectory::Reader reader(path);
+        check(reader.frames() == FRAMES, "frame count", reader.frames(), 0);
+
+        std::vector<glm::dvec3> positions, velocities;
+        for (size_t f = 0; f < reader.frames(); ++f) {
+            size_t n = truth[f].size() / 6;
+            check(reader.step(f) == f, "step", f, 0);
+            check(reader.bodies(f) == n, "body count", f, reader.bodies(f));
+            reader.readFrame(f, positions, velocities);
+            check(positions.size() == n, "frame size", f, positions.size());
+            for (size_t i = 0; i < std::min(n, positions.size()); ++i)
+                checkBody(truth[f], i, f, positions[i], velocities[i]);
+        }
+
+        // First and last body of a block, the next block, and an added body.
+        size_t block = Trajectory::BLOCK_BODIES;
+        for (size_t body : {size_t(0), block - 1, block, BODIES + ADDED - 1}) {
+            reader.readBody(body, positions, velocities);
+            check(positions.size() == FRAMES, "history size", 0, body);
+            for (size_t f = 0; f < positions.size(); ++f) {
+                if (body >= truth[f].size() / 6)
+                    check(std::isnan(positions[f].x),
+                          "body read before it existed", f, body);
+                else
+                    checkBody(truth[f], body, f, positions[f],
+                              velocities[f]);
+            }
+        }
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        ++failures;
+    }
+    std::filesystem::remove(path);
+
+    if (failures)
+        std::fprintf(stderr, "%d failures\n", failures);
+    else
+        std::printf("trajectory round trip ok\n");
+    return failures ? 1 : 0;
+}